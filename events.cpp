@@ -1,6 +1,9 @@
 #include "ecs/EventClient.hpp"
+#include "ecs/EventLog.hpp"
 #include "ecs/EventManager.hpp"
+#include <cstring>
 #include <iostream>
+#include <span>
 #include <string>
 
 struct MyEvent {
@@ -12,6 +15,31 @@ struct YourEvent {
   std::string s;
 };
 
+// Only the latest position per entity is delivered on each notify_clients
+struct Moved {
+  int entity;
+  float x;
+
+  int coalesce_key() const { return entity; }
+};
+
+template <> struct ECS::Event::EventCodec<YourEvent> {
+  static size_t size(YourEvent const &e) { return sizeof(e.i) + e.s.size(); }
+
+  static void encode(YourEvent const &e, std::byte *out) {
+    std::memcpy(out, &e.i, sizeof(e.i));
+    std::memcpy(out + sizeof(e.i), e.s.data(), e.s.size());
+  }
+
+  static YourEvent decode(std::span<std::byte const> in) {
+    YourEvent e;
+    std::memcpy(&e.i, in.data(), sizeof(e.i));
+    e.s.assign(reinterpret_cast<char const *>(in.data()) + sizeof(e.i),
+               in.size() - sizeof(e.i));
+    return e;
+  }
+};
+
 int main() {
   auto manager = ECS::Event::EventManager::make();
 
@@ -25,8 +53,29 @@ int main() {
     std::println(std::cout, "YourEvent {} {}", e.i, e.s);
   });
 
-  sender->emit(MyEvent{12});
-  sender->emit(YourEvent{14, "ayo"});
+  {
+    ECS::Event::EventLog log{"events.log"};
+    log.register_type<MyEvent>();
+    log.register_type<YourEvent>();
+    manager->record_to(&log);
+
+    sender->emit(MyEvent{12});
+    sender->emit(YourEvent{14, "ayo"});
+
+    manager->notify_clients();
+    manager->record_to(nullptr);
+  }
 
+  my_receiver->subscribe<Moved>([](Moved const &e) {
+    std::println(std::cout, "Moved {} to {}", e.entity, e.x);
+  });
+  for (auto i = 0; i != 10; ++i)
+    sender->emit(Moved{i % 2, static_cast<float>(i)});
   manager->notify_clients();
+
+  std::println(std::cout, "Replaying");
+  ECS::Event::EventReplay replay{"events.log"};
+  replay.register_type<MyEvent>();
+  replay.register_type<YourEvent>();
+  replay.replay(*manager);
 }
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <concepts>
+#include <coroutine>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace ECS {
+
+// Return type of async systems and other coroutines driven by a Scheduler.
+// A task starts running when called, like a plain function, until its first
+// co_await. It then belongs to whatever it waits on and frees itself when it
+// finishes.
+//
+// A system whose run returns Task is an async system: Ecs::run starts a task
+// per matching entity, or one for a query of only resources. The system
+// object has to outlive its tasks, and component references aren't stable
+// across a co_await, so take components by value or look them up again after
+// resuming.
+//
+// Every call to Ecs::run starts new tasks, whether or not the ones of the
+// previous call still wait. Run an async system once, typically as a loop
+// that waits and handles what is ready, and drive it by running the
+// Scheduler every frame; running the system itself every frame piles up
+// waiting tasks without bound.
+struct Task {
+  struct promise_type {
+    Task get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+};
+
+namespace detail {
+// Whether s.run(args...) starts a task, for the arguments in the tuple Args
+template <typename S, typename Args> constexpr bool starts_task = false;
+
+template <typename S, typename... As>
+constexpr bool starts_task<S, std::tuple<As...>> =
+    requires(S const &s, As... as) {
+      { s.run(as...) } -> std::same_as<Task>;
+    };
+} // namespace detail
+
+// Resumes tasks waiting for file descriptors to become readable or for
+// timers, on the thread calling poll. Polling once per frame, through
+// Ecs::run(scheduler), keeps I/O out of the simulation systems: their tasks
+// only run between systems, and many peers share one thread. Tasks still
+// waiting when the scheduler is destroyed are destroyed with it.
+//
+// Not thread-safe: tasks register with the scheduler from the thread that
+// starts or resumes them. Ecs::run therefore only accepts the
+// SerialExecutor for async systems, and poll must run on that same thread.
+class Scheduler {
+  using Clock = std::chrono::steady_clock;
+
+  struct Timer {
+    Clock::time_point deadline;
+    uint64_t sequence;
+    std::coroutine_handle<> task;
+
+    // Earliest deadline first, then in order of scheduling
+    bool operator>(Timer const &other) const {
+      return std::pair{deadline, sequence} >
+             std::pair{other.deadline, other.sequence};
+    }
+  };
+
+public:
+  Scheduler() : epoll_{epoll_create1(0)} {
+    if (epoll_ < 0) {
+      perror("epoll_create1");
+      std::exit(1);
+    }
+  }
+
+  Scheduler(Scheduler const &) = delete;
+  Scheduler &operator=(Scheduler const &) = delete;
+
+  ~Scheduler() {
+    for (auto &[fd, tasks] : readers_)
+      for (auto task : tasks)
+        task.destroy();
+    for (; !timers_.empty(); timers_.pop())
+      timers_.top().task.destroy();
+    close(epoll_);
+  }
+
+  // co_await scheduler.readable(fd) resumes once fd has data. The fd must
+  // stay open while tasks wait on it.
+  auto readable(int fd) {
+    struct Awaiter {
+      Scheduler &scheduler;
+      int fd;
+
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(std::coroutine_handle<> task) {
+        scheduler.wait_readable(fd, task);
+      }
+      void await_resume() const noexcept {}
+    };
+    return Awaiter{*this, fd};
+  }
+
+  // co_await scheduler.sleep_for(d) resumes on the first poll after d
+  auto sleep_for(Clock::duration duration) {
+    struct Awaiter {
+      Scheduler &scheduler;
+      Clock::time_point deadline;
+
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(std::coroutine_handle<> task) {
+        scheduler.timers_.push({deadline, scheduler.sequence_++, task});
+      }
+      void await_resume() const noexcept {}
+    };
+    return Awaiter{*this, Clock::now() + duration};
+  }
+
+  // Resumes every task that is ready. Waits up to timeout for one to become
+  // ready if none is; the default never blocks, as fits a frame loop.
+  // Negative timeouts count as 0.
+  void poll(std::chrono::milliseconds timeout = {}) {
+    timeout = std::max(timeout, std::chrono::milliseconds{});
+    if (!timers_.empty()) {
+      const auto until_timer =
+          std::chrono::ceil<std::chrono::milliseconds>(timers_.top().deadline -
+                                                       Clock::now());
+      timeout =
+          std::min(timeout, std::max(until_timer, std::chrono::milliseconds{}));
+    }
+
+    if (waiting_readers_ != 0 || timeout.count() > 0) {
+      std::array<epoll_event, 64> events;
+      const auto ready =
+          epoll_wait(epoll_, events.data(), static_cast<int>(events.size()),
+                     static_cast<int>(timeout.count()));
+      if (ready < 0 && errno != EINTR) {
+        perror("epoll_wait");
+        std::exit(1);
+      }
+
+      for (auto k = 0; k < ready; ++k)
+        resume_readers(events[static_cast<size_t>(k)].data.fd);
+    }
+
+    // Timers scheduled by resumed tasks wait for the next poll
+    const auto now = Clock::now();
+    const auto scheduled = sequence_;
+    while (!timers_.empty() && timers_.top().deadline <= now &&
+           timers_.top().sequence < scheduled) {
+      const auto task = timers_.top().task;
+      timers_.pop();
+      task.resume();
+    }
+  }
+
+  // Tasks currently waiting
+  size_t pending() const { return timers_.size() + waiting_readers_; }
+
+private:
+  // Fds stay registered after their waiters are resumed, as one-shot events
+  // that the next wait re-arms with a single epoll_ctl. Closing an fd
+  // unregisters it, so a reused fd number is added again.
+  void wait_readable(int fd, std::coroutine_handle<> task) {
+    const auto [it, added] = readers_.try_emplace(fd);
+    auto &tasks = it->second;
+    if (tasks.empty()) {
+      epoll_event event{.events = EPOLLIN | EPOLLONESHOT, .data = {.fd = fd}};
+      auto armed = !added && epoll_ctl(epoll_, EPOLL_CTL_MOD, fd, &event) == 0;
+      if (!armed && (added || errno == ENOENT))
+        armed = epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) == 0;
+      if (!armed) {
+        perror("epoll_ctl");
+        std::exit(1);
+      }
+    }
+    tasks.push_back(task);
+    ++waiting_readers_;
+  }
+
+  // Resumed tasks may wait on fd again, so the waiters are taken out first
+  void resume_readers(int fd) {
+    const auto it = readers_.find(fd);
+    if (it == readers_.end())
+      return;
+
+    const auto tasks = std::exchange(it->second, {});
+    waiting_readers_ -= tasks.size();
+
+    for (auto task : tasks)
+      task.resume();
+  }
+
+  int epoll_;
+  std::unordered_map<int, std::vector<std::coroutine_handle<>>> readers_;
+  size_t waiting_readers_{};
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<>> timers_;
+  uint64_t sequence_{};
+};
+
+} // namespace ECS
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Event.hpp"
+
+namespace ECS::Event {
+
+// Event types with a coalesce_key() are coalesced: of the events with equal
+// keys emitted between two notify_clients, clients only receive one. That is
+// the last one, unless the type has merge(newer), which folds a newer event
+// into the pending one.
+template <typename T>
+concept Coalescable = requires(T const &t) {
+  {
+    std::hash<std::remove_cvref_t<decltype(t.coalesce_key())>>{}(
+        t.coalesce_key())
+  } -> std::convertible_to<size_t>;
+};
+
+namespace details {
+class CoalescerBase {
+public:
+  virtual ~CoalescerBase() = default;
+
+  // Adds a type-erased event of the coalesced type, see Coalescer::add
+  virtual bool add(Event &&e) = 0;
+
+  // Moves the pending events to out in order of their first emission
+  virtual void flush(std::vector<Event> &out) = 0;
+};
+
+template <Coalescable T> class Coalescer final : public CoalescerBase {
+  using Key = std::remove_cvref_t<decltype(std::declval<T const &>()
+                                               .coalesce_key())>;
+
+public:
+  // Returns whether this is the first event since the last flush
+  bool add(T t) {
+    const auto first = pending_.empty();
+
+    const auto [it, inserted] =
+        index_.try_emplace(t.coalesce_key(), pending_.size());
+    if (inserted) {
+      pending_.push_back(std::move(t));
+      return first;
+    }
+
+    auto &pending = pending_[it->second];
+    if constexpr (requires { pending.merge(t); })
+      pending.merge(t);
+    else
+      pending = std::move(t);
+    return first;
+  }
+
+  bool add(Event &&e) override { return add(T{e.as<T>()}); }
+
+  void flush(std::vector<Event> &out) override {
+    for (auto &t : pending_)
+      out.emplace_back(std::move(t));
+    pending_.clear();
+    index_.clear();
+  }
+
+private:
+  std::vector<T> pending_;
+  std::unordered_map<Key, size_t> index_;
+};
+
+// Every coalesced type gets a process-wide slot in the coalescers of an
+// EventManager
+inline size_t next_coalescer_index() {
+  static std::atomic<size_t> next;
+  return next++;
+}
+
+// Assigned on first use, so it's set even when used during the static
+// initialization of another translation unit
+template <typename T> size_t coalescer_index() {
+  static const size_t index = next_coalescer_index();
+  return index;
+}
+} // namespace details
+
+} // namespace ECS::Event
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "Component.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <map>
+#include <utility>
+
+namespace ECS::detail {
+
+// Entities evicted from a world, kept in a file as fixed-size records: the
+// type of the entity followed by one slot per component, of which only those
+// in the type are meaningful. Evicting a range of ids stores one extent of
+// consecutive records. A record is cold while its type is valid.
+template <typename Type, Component... Cs> class ColdStore {
+  constexpr static auto valid_type_bit = sizeof...(Cs);
+
+  constexpr static std::array<size_t, sizeof...(Cs)> offsets = [] {
+    std::array<size_t, sizeof...(Cs)> result{};
+    auto offset = sizeof(Type);
+    auto k = 0uz;
+    ((result[k++] = offset, offset += is_resource_v<Cs> ? 0 : sizeof(Cs)),
+     ...);
+    return result;
+  }();
+
+  struct Extent {
+    size_t count;
+    size_t offset;
+    // Records that are still cold
+    size_t live;
+  };
+
+  using Extents = std::multimap<size_t, Extent>;
+
+public:
+  using ExtentHandle = Extents::iterator;
+
+  constexpr static auto record_size =
+      (sizeof(Type) + ... + (is_resource_v<Cs> ? 0 : sizeof(Cs)));
+
+  explicit ColdStore(std::filesystem::path const &path) : file_{path} {}
+
+  // Reserves records for the ids [first, first + count). The caller writes
+  // every record, see record(), then calls close_extent.
+  ExtentHandle open_extent(size_t first, size_t count) {
+    const auto offset = allocate(count * record_size);
+    longest_extent_ = std::max(longest_extent_, count);
+    return extents_.emplace(first, Extent{count, offset, 0});
+  }
+
+  std::byte *record(ExtentHandle extent, size_t k) {
+    return file_.data() + extent->second.offset + k * record_size;
+  }
+
+  // Records how many records of the extent are cold and pushes it out of
+  // memory
+  void close_extent(ExtentHandle it, size_t live) {
+    it->second.live = live;
+    cold_ += live;
+
+    if (live == 0) {
+      release(it);
+      return;
+    }
+    file_.page_out(it->second.offset, it->second.count * record_size);
+  }
+
+  // The cold record of entity i, or nullptr. An id can be covered by several
+  // extents, of which at most one holds it cold.
+  std::byte *find(size_t i) {
+    for (auto it = extents_.upper_bound(i); it != extents_.begin();) {
+      --it;
+      if (it->first + longest_extent_ <= i)
+        break;
+      if (i - it->first >= it->second.count)
+        continue;
+
+      auto *record =
+          file_.data() + it->second.offset + (i - it->first) * record_size;
+      if (type(record).test(valid_type_bit))
+        return record;
+    }
+    return nullptr;
+  }
+
+  // Marks the record of entity i as loaded back into the world
+  void loaded(size_t i, std::byte *record) {
+    set_type(record, Type{});
+    --cold_;
+
+    auto it = std::prev(extents_.upper_bound(i));
+    while (record < file_.data() + it->second.offset ||
+           record >= file_.data() + it->second.offset +
+                         it->second.count * record_size)
+      --it;
+
+    if (--it->second.live == 0)
+      release(it);
+  }
+
+  static Type type(std::byte const *record) {
+    Type type;
+    std::memcpy(&type, record, sizeof(Type));
+    return type;
+  }
+
+  static void set_type(std::byte *record, Type const &type) {
+    std::memcpy(record, &type, sizeof(Type));
+  }
+
+  template <Component C> static C get(std::byte const *record) {
+    std::array<std::byte, sizeof(C)> bytes;
+    std::memcpy(bytes.data(), record + offsets[index_for<C, Cs...>],
+                sizeof(C));
+    return std::bit_cast<C>(bytes);
+  }
+
+  template <Component C> static void set(std::byte *record, C const &c) {
+    std::memcpy(record + offsets[index_for<C, Cs...>], &c, sizeof(C));
+  }
+
+  // Number of cold entities
+  size_t size() const { return cold_; }
+
+  size_t bytes() const { return file_.size(); }
+
+private:
+  // First fit among released regions, else appended to the file
+  size_t allocate(size_t bytes) {
+    const auto it = std::ranges::find_if(
+        free_, [=](auto const &region) { return region.second >= bytes; });
+    if (it != free_.end()) {
+      const auto [offset, size] = *it;
+      free_.erase(it);
+      if (size != bytes)
+        free_.emplace(offset + bytes, size - bytes);
+      return offset;
+    }
+
+    const auto offset = end_;
+    end_ += bytes;
+    if (end_ > file_.size())
+      file_.resize(std::max(end_, 2 * file_.size()));
+    return offset;
+  }
+
+  // Merges the region of the extent with the free regions next to it, so
+  // churn doesn't leave the file fragmented into extent-sized holes
+  void release(ExtentHandle it) {
+    auto offset = it->second.offset;
+    auto size = it->second.count * record_size;
+    extents_.erase(it);
+
+    if (const auto next = free_.find(offset + size); next != free_.end()) {
+      size += next->second;
+      free_.erase(next);
+    }
+    if (auto prev = free_.lower_bound(offset); prev != free_.begin()) {
+      --prev;
+      if (prev->first + prev->second == offset) {
+        offset = prev->first;
+        size += prev->second;
+        free_.erase(prev);
+      }
+    }
+
+    // The tail of the file is reused by appending
+    if (offset + size != end_) {
+      free_.emplace(offset, size);
+      return;
+    }
+    end_ = offset;
+
+    // Once at most a quarter of the file is in use, it shrinks to twice that,
+    // so it can grow a little again without remapping
+    constexpr auto page_size = 4096uz;
+    if (end_ <= file_.size() / 4)
+      file_.resize((2 * end_ + page_size - 1) & ~(page_size - 1));
+  }
+
+  MappedFile file_;
+  // By first id
+  Extents extents_;
+  size_t longest_extent_{};
+  // Regions of the file before end_ that no extent uses, from offset to
+  // size. Adjacent regions are always merged.
+  std::map<size_t, size_t> free_;
+  size_t end_{};
+  size_t cold_{};
+};
+
+} // namespace ECS::detail
@@ -8,17 +8,23 @@ namespace ECS {
 template <typename T>
 concept Component = true;
 
+// Listing Resource<R> among the components of a world makes R a singleton
+// of that world: one instance stored inline, not attached to any entity.
+// Systems get it by naming Resource<R> as a query term.
+template <typename R> struct Resource {
+  using type = R;
+};
+
 namespace detail {
-template <typename, size_t, typename...> struct BitFor;
+template <typename, typename...> struct IndexFor;
 
-template <typename T, size_t I, typename Head, typename... Tail>
-struct BitFor<T, I, Head, Tail...> {
-  constexpr static auto value = BitFor<T, I << 1, Tail...>::value;
+template <typename T, typename Head, typename... Tail>
+struct IndexFor<T, Head, Tail...> {
+  constexpr static size_t value = 1 + IndexFor<T, Tail...>::value;
 };
 
-template <typename T, size_t I, typename... Tail>
-struct BitFor<T, I, T, Tail...> {
-  constexpr static auto value = I;
+template <typename T, typename... Tail> struct IndexFor<T, T, Tail...> {
+  constexpr static size_t value = 0;
 };
 
 template <typename T, typename Head, typename... Tail> struct Contains {
@@ -26,6 +32,14 @@ template <typename T, typename Head, typename... Tail> struct Contains {
       Contains<T, Head>::value || Contains<T, Tail...>::value;
 };
 
+template <typename T> struct IsResource {
+  constexpr static bool value = false;
+};
+
+template <typename R> struct IsResource<Resource<R>> {
+  constexpr static bool value = true;
+};
+
 template <typename T> struct Contains<T, T> {
   constexpr static auto value = true;
 };
@@ -37,9 +51,13 @@ template <typename T, typename U> struct Contains<T, U> {
 } // namespace detail
 
 template <Component T, Component... Cs>
-constexpr size_t bit_for = detail::BitFor<T, 1, Cs...>::value;
+constexpr size_t index_for = detail::IndexFor<T, Cs...>::value;
 
 template <typename T, typename... Us>
 constexpr auto contains_v =
     detail::Contains<std::remove_cvref_t<T>, Us...>::value;
+
+template <typename T>
+constexpr auto is_resource_v =
+    detail::IsResource<std::remove_cvref_t<T>>::value;
 } // namespace ECS
@@ -4,6 +4,7 @@
 #include "SparseSet.hpp"
 
 #include <cstddef>
+#include <optional>
 #include <utility>
 
 namespace ECS {
@@ -17,10 +18,28 @@ public:
 
   constexpr C &get(size_t i) { return entities_.get(i); }
 
+  constexpr C &get_untracked(size_t i) { return entities_.get_untracked(i); }
+
+  constexpr C const &get(size_t i) const { return entities_.get(i); }
+
+  constexpr SparseSet<C> &storage() { return entities_; }
+
 private:
   SparseSet<C> entities_;
 };
 
+template <Component R> class ComponentStorageImpl<Resource<R>> {
+public:
+  constexpr void remove(size_t) {}
+
+  constexpr void update_length(size_t) {}
+
+  constexpr std::optional<R> &resource() { return resource_; }
+
+private:
+  std::optional<R> resource_;
+};
+
 template <Component... Cs>
 class ComponentStorage : ComponentStorageImpl<Cs>... {
 public:
@@ -42,10 +61,36 @@ public:
     return ComponentStorageImpl<C>::get(i);
   }
 
+  // For runs while no snapshot journals the world, see Ecs::with_journal
+  template <Component C>
+    requires contains_v<C, Cs...>
+  constexpr C &get_untracked(size_t i) {
+    return ComponentStorageImpl<C>::get_untracked(i);
+  }
+
+  // Doesn't count as a write for snapshots
+  template <Component C>
+    requires contains_v<C, Cs...>
+  constexpr C const &get(size_t i) const {
+    return ComponentStorageImpl<C>::get(i);
+  }
+
   template <Component C>
     requires contains_v<C, Cs...>
   constexpr void update_length(size_t i) {
     ComponentStorageImpl<C>::update_length(i);
   }
+
+  template <Component C>
+    requires contains_v<C, Cs...>
+  constexpr SparseSet<C> &storage() {
+    return ComponentStorageImpl<C>::storage();
+  }
+
+  template <Component R>
+    requires contains_v<Resource<R>, Cs...>
+  constexpr std::optional<R> &resource() {
+    return ComponentStorageImpl<Resource<R>>::resource();
+  }
 };
 } // namespace ECS
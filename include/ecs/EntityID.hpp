@@ -4,12 +4,21 @@
 
 #include <compare>
 #include <cstddef>
+#include <functional>
 
 namespace ECS {
 
+namespace detail {
+template <typename> struct QueryTerm;
+}
+
 class EntityID {
 public:
   template <Component...> friend class Ecs;
+  template <typename T, T, Component...> friend class View;
+  template <typename> friend struct detail::QueryTerm;
+  friend class SpatialGrid;
+  friend struct std::hash<EntityID>;
 
   constexpr auto operator<=>(EntityID const &) const = default;
 
@@ -20,3 +29,10 @@ private:
 };
 
 } // namespace ECS
+
+// E.g. for keying coalesced events by entity
+template <> struct std::hash<ECS::EntityID> {
+  size_t operator()(ECS::EntityID id) const noexcept {
+    return std::hash<size_t>{}(id.value_);
+  }
+};
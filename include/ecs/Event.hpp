@@ -96,8 +96,17 @@ public:
     return *this;
   }
 
+  // Identifies the type of an event, see is()
+  using TypeKey = void (*)(details::EventStorage &);
+
+  template <typename T> static TypeKey key_of() noexcept {
+    return VTable<T>::destroy;
+  }
+
+  TypeKey key() const noexcept { return vtable_.destory; }
+
   template <typename T> bool is() const noexcept {
-    return vtable_.destory == VTable<T>::destroy;
+    return key() == key_of<T>();
   }
 
   template <typename T> T const &as() const {
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "Event.hpp"
+#include "EventManager.hpp"
+#include "MappedFile.hpp"
+#include "TypeName.hpp"
+
+namespace ECS::Event {
+
+// How events of type T are written to an EventLog. Trivially copyable events
+// are copied bytewise. Specialize for other events with
+//   static size_t size(T const &);
+//   static void encode(T const &, std::byte *out);
+//   static T decode(std::span<std::byte const>);
+template <typename T> struct EventCodec {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "Specialize EventCodec for events that aren't trivially "
+                "copyable");
+
+  // Fixed-size encodings are stored without a length
+  constexpr static size_t fixed_size = sizeof(T);
+
+  static size_t size(T const &) { return sizeof(T); }
+
+  static void encode(T const &t, std::byte *out) {
+    std::memcpy(out, &t, sizeof(T));
+  }
+
+  static T decode(std::span<std::byte const> in) {
+    assert(in.size() == sizeof(T));
+    std::array<std::byte, sizeof(T)> bytes;
+    std::memcpy(bytes.data(), in.data(), sizeof(T));
+    return std::bit_cast<T>(bytes);
+  }
+};
+
+namespace details {
+template <typename T> constexpr uint32_t fixed_size_of() {
+  if constexpr (requires { EventCodec<T>::fixed_size; })
+    return EventCodec<T>::fixed_size;
+  else
+    return 0;
+}
+
+// Layout of a log: a magic number and the 64-bit length of the log up to its
+// last complete record, then records starting with a 16-bit type id. The
+// first record of each type defines the id, followed by its fixed size (0 for
+// length-prefixed events) and its name. Events are then stored as the id, a
+// 32-bit length unless the type has a fixed size, and the encoding.
+constexpr std::array<char, 8> log_magic{'E', 'C', 'S', 'E', 'V', 'L', 'O', 'G'};
+constexpr auto log_header_size = log_magic.size() + sizeof(uint64_t);
+constexpr uint16_t definition_id = 0xffff;
+} // namespace details
+
+// Append-only binary log of the events an EventManager emits, see
+// EventManager::record_to. Records are written straight into a shared
+// mapping of the file, grown by doubling, so recording makes no syscalls
+// apart from the occasional resize. Only events of registered types are
+// recorded.
+class EventLog {
+  struct Type {
+    Event::TypeKey key;
+    uint32_t fixed_size;
+    size_t (*size)(Event const &);
+    void (*encode)(Event const &, std::byte *);
+    std::string_view name;
+    bool defined;
+  };
+
+public:
+  explicit EventLog(std::filesystem::path const &path);
+
+  EventLog(EventLog const &) = delete;
+  EventLog &operator=(EventLog const &) = delete;
+
+  // Cuts the file to the recorded length
+  ~EventLog();
+
+  // At most 65535 types can be registered
+  template <typename T> void register_type() {
+    add_type({
+        .key = Event::key_of<T>(),
+        .fixed_size = details::fixed_size_of<T>(),
+        .size = [](Event const &e) { return EventCodec<T>::size(e.as<T>()); },
+        .encode =
+            [](Event const &e, std::byte *out) {
+              EventCodec<T>::encode(e.as<T>(), out);
+            },
+        .name = ECS::detail::type_name<T>(),
+        .defined = false,
+    });
+  }
+
+  void record(Event const &e) noexcept;
+
+  // Events recorded so far, and the bytes they take
+  size_t size() const noexcept { return events_; }
+
+  size_t bytes() const noexcept { return end_; }
+
+private:
+  void add_type(Type type);
+
+  void define(Type &type, uint16_t id);
+
+  // Makes room for n more bytes and returns where they start
+  std::byte *append(size_t n);
+
+  template <typename T> void append_value(T t) {
+    std::memcpy(append(sizeof(T)), &t, sizeof(T));
+  }
+
+  ECS::detail::MappedFile file_;
+  std::vector<Type> types_;
+  size_t end_{};
+  size_t events_{};
+};
+
+// Re-emits the events of a log into an EventManager as fast as it can take
+// them, e.g. to benchmark dispatch against recorded traffic. Types are matched
+// to the log by name; events of unregistered types, and of types whose fixed
+// size differs from the one in the log, are skipped.
+class EventReplay {
+  using Emit = void (*)(EventManager &, std::span<std::byte const>);
+
+  struct Type {
+    std::string_view name;
+    uint32_t fixed_size;
+    Emit emit;
+  };
+
+public:
+  explicit EventReplay(std::filesystem::path const &path);
+
+  template <typename T> void register_type() {
+    types_.push_back({
+        .name = ECS::detail::type_name<T>(),
+        .fixed_size = details::fixed_size_of<T>(),
+        .emit =
+            [](EventManager &manager, std::span<std::byte const> in) {
+              manager.emit(EventCodec<T>::decode(in));
+            },
+    });
+  }
+
+  // Emits every event of the log, notifying the clients of manager after
+  // every `batch` events and at the end, or only at the end if batch is 0.
+  // Returns how many were emitted.
+  size_t replay(EventManager &manager, size_t batch = 1024);
+
+private:
+  ECS::detail::MappedFile file_;
+  std::vector<Type> types_;
+};
+
+} // namespace ECS::Event
@@ -1,13 +1,22 @@
 #pragma once
 
+#include <cassert>
+#include <chrono>
+#include <cstdint>
 #include <memory>
 #include <queue>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "Coalescer.hpp"
 #include "Event.hpp"
+#include "TimerWheel.hpp"
 
 namespace ECS::Event {
 class EventClient;
+class EventLog;
 
 class EventManager : public std::enable_shared_from_this<EventManager> {
   struct Badge {};
@@ -21,19 +30,119 @@ public:
     return std::make_shared<EventManager>(Badge{});
   }
 
-  bool has_pending_events() const noexcept { return !events_.empty(); }
+  bool has_pending_events() const noexcept {
+    return !events_.empty() || !dirty_.empty();
+  }
 
   std::shared_ptr<EventClient> make_client() noexcept;
 
+  // Coalescable events are held back until the next notify_clients, where
+  // they are queued after the events emitted directly
   template <typename T> void emit(T &&t) noexcept {
-    _emit(Event{std::forward<T>(t)});
+    using E = std::remove_cvref_t<T>;
+    if constexpr (Coalescable<E>) {
+      auto &pending = coalescer<E>();
+      if (pending.add(E{std::forward<T>(t)}))
+        dirty_.push_back(&pending);
+    } else {
+      _emit(Event{std::forward<T>(t)});
+    }
   }
 
   void notify_clients() noexcept;
 
+  // Emits t once `delay` ticks have passed, see tick()
+  template <typename T> TimerID schedule(uint64_t delay, T &&t) {
+    using E = std::remove_cvref_t<T>;
+    if constexpr (Coalescable<E>)
+      coalescer<E>();
+    return timers_.schedule(
+        delay, 0, [e = E{std::forward<T>(t)}]() mutable {
+          return Event{std::move(e)};
+        });
+  }
+
+  // Emits a copy of t every `period` ticks, starting `period` ticks from now.
+  // The period must be positive.
+  template <typename T> TimerID schedule_every(uint64_t period, T t) {
+    assert(period > 0);
+    if constexpr (Coalescable<T>)
+      coalescer<T>();
+    return timers_.schedule(period, period,
+                            [t = std::move(t)] { return Event{T{t}}; });
+  }
+
+  // Durations are rounded up to whole ticks, see set_tick_length
+  template <typename T>
+  TimerID schedule(std::chrono::nanoseconds delay, T &&t) {
+    return schedule(to_ticks(delay), std::forward<T>(t));
+  }
+
+  template <typename T>
+  TimerID schedule_every(std::chrono::nanoseconds period, T t) {
+    assert(period.count() > 0);
+    return schedule_every(std::max(to_ticks(period), uint64_t{1}),
+                          std::move(t));
+  }
+
+  // Returns whether the event was still pending
+  bool cancel(TimerID id) noexcept { return timers_.cancel(id); }
+
+  // Advances the timers by n ticks. Events that became due are emitted
+  // together, in the order they fell due, for the next notify_clients.
+  // Coalescable ones are coalesced like those passed to emit.
+  void tick(uint64_t n = 1) noexcept;
+
+  // Advances the timers by elapsed wall-clock time, carrying over partial
+  // ticks
+  void advance(std::chrono::nanoseconds elapsed) noexcept;
+
+  // The length must be positive
+  void set_tick_length(std::chrono::nanoseconds length) noexcept {
+    assert(length.count() > 0);
+    tick_length_ = length;
+  }
+
+  // Appends every emitted event to log, until called with nullptr. The log
+  // must outlive the recording.
+  void record_to(EventLog *log) noexcept { log_ = log; }
+
 private:
+  uint64_t to_ticks(std::chrono::nanoseconds d) const noexcept {
+    const auto rounded = d + tick_length_ - std::chrono::nanoseconds{1};
+    return static_cast<uint64_t>(rounded / tick_length_);
+  }
+
+  template <Coalescable T> details::Coalescer<T> &coalescer() {
+    const auto i = details::coalescer_index<T>();
+    if (i >= coalescers_.size())
+      coalescers_.resize(i + 1);
+    if (!coalescers_[i]) {
+      coalescers_[i] = std::make_unique<details::Coalescer<T>>();
+      coalescers_by_key_.emplace(Event::key_of<T>(), coalescers_[i].get());
+    }
+    return static_cast<details::Coalescer<T> &>(*coalescers_[i]);
+  }
+
+  // Queues the coalesced events of the frame
+  void flush_coalesced() noexcept;
+
   void _emit(Event) noexcept;
   std::vector<std::weak_ptr<EventClient>> clients_;
   std::queue<Event> events_;
+  EventLog *log_{};
+
+  TimerWheel timers_;
+  std::chrono::nanoseconds tick_length_{std::chrono::milliseconds{1}};
+  std::chrono::nanoseconds elapsed_{};
+  // Reused for the events released by each tick or flush
+  std::vector<Event> due_;
+
+  // By details::coalescer_index(), and those holding events
+  std::vector<std::unique_ptr<details::CoalescerBase>> coalescers_;
+  std::vector<details::CoalescerBase *> dirty_;
+  // For events that reach the manager type-erased, from the timers
+  std::unordered_map<Event::TypeKey, details::CoalescerBase *>
+      coalescers_by_key_;
 };
 } // namespace ECS::Event
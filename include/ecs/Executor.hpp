@@ -1,20 +1,59 @@
 #pragma once
 
+#include <algorithm>
 #include <concepts>
 #include <cstddef>
 
 #include <thread>
 #include <vector>
 
+#include "Numa.hpp"
+
 namespace ECS {
 template <typename E>
 concept Executor = requires(E &e) { e.run(size_t{}, [](size_t) {}); };
 
+// Executors that hand out contiguous blocks [begin, end) instead of single
+// indices, so a kernel can keep invariants out of its inner loop and the
+// compiler can vectorize across a block.
+template <typename E>
+concept RangeExecutor = Executor<E> && requires(E &e) {
+  e.run_range(size_t{}, [](size_t, size_t) {});
+};
+
+namespace detail {
+constexpr auto cache_line_size = 64uz;
+
+// Keeps per-worker state from sharing a cache line with anything else
+template <typename T> struct alignas(cache_line_size) CacheAligned {
+  T value;
+};
+
+// Runs f over blocks of [0, n), falling back to blocks of one index for
+// executors that only provide run
+template <Executor E>
+constexpr void run_range(E &e, size_t n,
+                         std::invocable<size_t, size_t> auto f) {
+  if constexpr (RangeExecutor<E>)
+    e.run_range(n, f);
+  else
+    e.run(n, [&](size_t i) { f(i, i + 1); });
+}
+} // namespace detail
+
 struct SerialExecutor {
+  constexpr void run_range(size_t num_entities,
+                           std::invocable<size_t, size_t> auto f) {
+    if (num_entities != 0)
+      f(0uz, num_entities);
+  }
+
   constexpr void run(size_t num_entities, std::invocable<size_t> auto f) {
-    for (auto i = 0uz; i != num_entities; ++i) {
-      f(i);
-    }
+    run_range(num_entities, [&](size_t begin, size_t end) {
+      for (auto i = begin; i != end; ++i) {
+        f(i);
+      }
+    });
   }
 };
 
@@ -25,23 +64,47 @@ public:
       n_threads = 1;
   }
 
-  constexpr void run(size_t num_entities, std::invocable<size_t> auto f) {
+  // Pins the t-th worker of every run to the t-th CPU, with CPUs grouped by
+  // NUMA node. As the partitioning of run only depends on the entity count,
+  // each block of entities is then always processed on the same node, which
+  // is where Ecs::reserve(n, executor) places its storage.
+  static ParallelExecutor pinned() {
+    ParallelExecutor executor;
+    executor.cpus_ = detail::node_ordered_cpus();
+    executor.n_threads = executor.cpus_.size();
+    return executor;
+  }
+
+  // Every worker gets one block
+  constexpr void run_range(size_t num_entities,
+                           std::invocable<size_t, size_t> auto f) {
     std::vector<std::jthread> thread_pool;
-    thread_pool.resize(n_threads);
+    thread_pool.reserve(n_threads);
 
     // Round up
     auto const entities_per_thread = (num_entities - 1) / n_threads + 1;
 
     for (auto i = 0uz; i < num_entities; i += entities_per_thread) {
-      thread_pool.emplace_back([=, &f]() mutable {
-        for (auto _ = 0uz; _ != entities_per_thread; ++_) {
-          f(i++);
-        }
+      auto const end = std::min(i + entities_per_thread, num_entities);
+      auto const worker = i / entities_per_thread;
+      thread_pool.emplace_back([=, this, &f]() {
+        if (!cpus_.empty())
+          detail::pin_current_thread(cpus_[worker % cpus_.size()]);
+        f(i, end);
       });
     }
   }
 
+  constexpr void run(size_t num_entities, std::invocable<size_t> auto f) {
+    run_range(num_entities, [&](size_t begin, size_t end) {
+      for (auto i = begin; i != end; ++i) {
+        f(i);
+      }
+    });
+  }
+
 private:
   size_t n_threads{std::jthread::hardware_concurrency()};
+  std::vector<unsigned> cpus_;
 };
 } // namespace ECS
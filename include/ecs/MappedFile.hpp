@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ECS::detail {
+
+template <typename T> T check(T result, char const *what) {
+  if (result < 0) {
+    perror(what);
+    std::exit(1);
+  }
+  return result;
+}
+
+// Shared mapping of a whole file, grown on demand. Growing may move the
+// mapping. Files opened for reading are mapped read-only and can't be
+// resized.
+class MappedFile {
+public:
+  enum class Mode { create, read };
+
+  explicit MappedFile(std::filesystem::path const &path,
+                      Mode mode = Mode::create)
+      : fd_{check(open(path.c_str(),
+                       mode == Mode::create ? O_RDWR | O_CREAT | O_TRUNC
+                                            : O_RDONLY,
+                       0600),
+                  "MappedFile::open")},
+        writable_{mode == Mode::create} {
+    if (writable_)
+      return;
+
+    struct stat stat;
+    check(fstat(fd_, &stat), "MappedFile::fstat");
+    map(static_cast<size_t>(stat.st_size));
+  }
+
+  MappedFile(MappedFile const &) = delete;
+  MappedFile &operator=(MappedFile const &) = delete;
+
+  ~MappedFile() {
+    if (data_)
+      munmap(data_, size_);
+    close(fd_);
+  }
+
+  std::byte *data() { return data_; }
+
+  size_t size() const { return size_; }
+
+  void resize(size_t size) {
+    check(ftruncate(fd_, static_cast<off_t>(size)), "MappedFile::ftruncate");
+    map(size);
+  }
+
+  // Writes back and drops the whole pages of the range from memory. They are
+  // read from the file again on the next access.
+  void page_out([[maybe_unused]] size_t offset, [[maybe_unused]] size_t n) {
+#ifdef MADV_PAGEOUT
+    constexpr auto page_size = 4096uz;
+    const auto begin = (offset + page_size - 1) & ~(page_size - 1);
+    const auto end = (offset + n) & ~(page_size - 1);
+    if (begin < end)
+      madvise(data_ + begin, end - begin, MADV_PAGEOUT);
+#endif
+  }
+
+private:
+  void map(size_t size) {
+    if (size == 0) {
+      if (data_)
+        munmap(data_, size_);
+      data_ = nullptr;
+      size_ = 0;
+      return;
+    }
+
+    void *data;
+    if (data_)
+      data = mremap(data_, size_, size, MREMAP_MAYMOVE);
+    else
+      data = mmap(nullptr, size, PROT_READ | (writable_ ? PROT_WRITE : 0),
+                  MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+      perror("MappedFile::mmap");
+      std::exit(1);
+    }
+
+    data_ = static_cast<std::byte *>(data);
+    size_ = size;
+  }
+
+  int fd_;
+  bool writable_;
+  std::byte *data_{};
+  size_t size_{};
+};
+
+} // namespace ECS::detail
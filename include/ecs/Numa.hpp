@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <sys/mman.h>
+#endif
+
+namespace ECS {
+// Options for Ecs::reserve(n, executor, options)
+struct NumaOptions {
+  // Back storage with transparent huge pages where possible
+  bool huge_pages = false;
+  // Dense entries to preallocate per component. Bulk creation appends to
+  // dense storage in entity order, so it is split among the workers in
+  // proportion to their blocks of ids.
+  size_t dense_capacity = 0;
+};
+} // namespace ECS
+
+// Helpers for placing large worlds on multi-socket machines. Linux places a
+// page on the NUMA node of the thread that first writes it, so storage has to
+// be allocated untouched and then written by the threads that will use it.
+namespace ECS::detail {
+
+// Allocator that default-initializes instead of value-initializing, so that
+// resizing a vector of trivial types doesn't touch the new memory.
+template <typename T, typename A = std::allocator<T>>
+class DefaultInitAllocator : public A {
+  using Traits = std::allocator_traits<A>;
+
+public:
+  template <typename U> struct rebind {
+    using other =
+        DefaultInitAllocator<U, typename Traits::template rebind_alloc<U>>;
+  };
+
+  using A::A;
+
+  template <typename U>
+  void construct(U *p) noexcept(std::is_nothrow_default_constructible_v<U>) {
+    ::new (static_cast<void *>(p)) U;
+  }
+
+  template <typename U, typename... Args>
+  void construct(U *p, Args &&...args) {
+    Traits::construct(static_cast<A &>(*this), p, std::forward<Args>(args)...);
+  }
+};
+
+constexpr auto huge_page_size = 2uz << 20;
+
+// Requests transparent huge pages for the 2MiB-aligned part of the range.
+// Has to happen before the range is first touched to take effect.
+inline void advise_huge_pages([[maybe_unused]] void *p,
+                              [[maybe_unused]] size_t bytes) {
+#ifdef MADV_HUGEPAGE
+  const auto first = reinterpret_cast<std::uintptr_t>(p);
+  const auto begin = (first + huge_page_size - 1) & ~(huge_page_size - 1);
+  const auto end = (first + bytes) & ~(huge_page_size - 1);
+  if (begin < end)
+    madvise(reinterpret_cast<void *>(begin), end - begin, MADV_HUGEPAGE);
+#endif
+}
+
+// Faults the pages of the range in from the calling thread without writing
+// to them, placing them on the thread's NUMA node.
+inline void populate([[maybe_unused]] void *p, [[maybe_unused]] size_t bytes) {
+#ifdef MADV_POPULATE_WRITE
+  constexpr auto page_size = 4096uz;
+  const auto first = reinterpret_cast<std::uintptr_t>(p);
+  const auto begin = first & ~(page_size - 1);
+  const auto end = first + bytes;
+  if (bytes != 0)
+    madvise(reinterpret_cast<void *>(begin), end - begin, MADV_POPULATE_WRITE);
+#endif
+}
+
+// All online CPUs, grouped by NUMA node. Falls back to 0..n-1 when the node
+// topology isn't available.
+inline std::vector<unsigned> node_ordered_cpus() {
+  std::vector<unsigned> cpus;
+
+#ifdef __linux__
+  for (auto node = 0u;; ++node) {
+    std::ifstream list{"/sys/devices/system/node/node" + std::to_string(node) +
+                       "/cpulist"};
+    if (!list)
+      break;
+
+    // Format: comma separated CPUs or ranges, e.g. "0-15,32-47"
+    unsigned first;
+    while (list >> first) {
+      auto last = first;
+      if (list.peek() == '-') {
+        list.get();
+        list >> last;
+      }
+      for (auto cpu = first; cpu <= last; ++cpu)
+        cpus.push_back(cpu);
+      if (list.peek() == ',')
+        list.get();
+    }
+  }
+#endif
+
+  if (cpus.empty())
+    for (auto cpu = 0u; cpu < std::max(1u, std::thread::hardware_concurrency());
+         ++cpu)
+      cpus.push_back(cpu);
+
+  return cpus;
+}
+
+inline void pin_current_thread([[maybe_unused]] unsigned cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+} // namespace ECS::detail
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Component.hpp"
+#include "EntityID.hpp"
+
+#include <functional>
+#include <vector>
+
+namespace ECS::detail {
+
+// Callbacks registered through Ecs::on_add / Ecs::on_remove for component C
+template <Component C> struct Observers {
+  using Observer = std::move_only_function<void(EntityID, C &)>;
+
+  std::vector<Observer> added;
+  std::vector<Observer> removed;
+};
+
+} // namespace ECS::detail
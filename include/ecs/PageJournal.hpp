@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace ECS::detail {
+
+// Undo journal of a byte buffer at page granularity. Writers call touch()
+// before changing bytes of the buffer, and the first touch of a page after a
+// checkpoint saves the page as it was at the checkpoint. Undoing the saved
+// pages of every checkpoint since some earlier one, newest first, takes the
+// buffer back to that state while copying only the pages written in between.
+//
+// Touching is a no-op until the first checkpoint and for pages past the size
+// of the buffer at the last one. Touching is safe from several threads, as
+// long as the buffer isn't resized meanwhile.
+class PageJournal {
+public:
+  constexpr static auto page_size = 4096uz;
+
+  // Pages of a buffer as of a checkpoint
+  struct Log {
+    // Size of the buffer at the checkpoint
+    size_t size{};
+    std::vector<size_t> pages;
+    // page_size bytes for each of pages
+    std::vector<std::byte> bytes;
+  };
+
+  PageJournal() = default;
+
+  // Copies of a buffer start out untracked
+  PageJournal(PageJournal const &) noexcept {}
+  PageJournal &operator=(PageJournal const &) noexcept {
+    stop();
+    return *this;
+  }
+
+  PageJournal(PageJournal &&) noexcept = default;
+  PageJournal &operator=(PageJournal &&) noexcept = default;
+
+  // Call before writing n bytes at offset of buffer
+  void touch(std::span<std::byte const> buffer, size_t offset, size_t n) {
+    if (n == 0 || offset >= tracked_pages_ * page_size)
+      return;
+
+    const auto last = std::min((offset + n - 1) / page_size, tracked_pages_ - 1);
+    for (auto p = offset / page_size; p <= last; ++p)
+      if (!(std::atomic_ref{dirty_[p / 64]}.load(std::memory_order_acquire) &
+            bit(p)))
+        save(buffer, p);
+  }
+
+  // Starts over from the current state of the buffer, which is `size` bytes,
+  // and returns the pages saved since the previous checkpoint
+  Log checkpoint(size_t size) {
+    if (!mutex_)
+      mutex_ = std::make_unique<std::mutex>();
+
+    for (const auto p : log_.pages)
+      dirty_[p / 64] &= ~bit(p);
+    tracked_pages_ = (size + page_size - 1) / page_size;
+    dirty_.resize((tracked_pages_ + 63) / 64);
+
+    return std::exchange(log_, Log{.size = size, .pages = {}, .bytes = {}});
+  }
+
+  // Stops tracking and drops the saved pages until the next checkpoint
+  void stop() noexcept {
+    dirty_ = {};
+    tracked_pages_ = 0;
+    log_ = {};
+  }
+
+  // Heap memory the journal holds
+  size_t bytes() const {
+    return dirty_.capacity() * sizeof(uint64_t) +
+           log_.pages.capacity() * sizeof(size_t) + log_.bytes.capacity();
+  }
+
+  // Writes the pages of log back into buffer, which the caller has resized
+  // to log.size bytes
+  static void undo(Log const &log, std::span<std::byte> buffer) {
+    for (auto k = 0uz; k != log.pages.size(); ++k) {
+      const auto offset = log.pages[k] * page_size;
+      if (offset >= buffer.size())
+        continue;
+      std::memcpy(buffer.data() + offset, log.bytes.data() + k * page_size,
+                  std::min(page_size, buffer.size() - offset));
+    }
+  }
+
+private:
+  constexpr static uint64_t bit(size_t p) { return uint64_t{1} << (p % 64); }
+
+  void save(std::span<std::byte const> buffer, size_t p) {
+    std::scoped_lock lock{*mutex_};
+    std::atomic_ref word{dirty_[p / 64]};
+    if (word.load(std::memory_order_relaxed) & bit(p))
+      return;
+
+    // Pages past the end of the buffer were saved when it shrank, before
+    // it could grow back over them
+    const auto offset = p * page_size;
+    const auto n =
+        offset < buffer.size() ? std::min(page_size, buffer.size() - offset) : 0;
+    log_.pages.push_back(p);
+    log_.bytes.resize(log_.bytes.size() + page_size);
+    if (n != 0)
+      std::memcpy(log_.bytes.data() + log_.bytes.size() - page_size,
+                  buffer.data() + offset, n);
+
+    // Writers wait for the copy before changing the page
+    word.fetch_or(bit(p), std::memory_order_release);
+  }
+
+  std::vector<uint64_t> dirty_;
+  size_t tracked_pages_{};
+  Log log_;
+  std::unique_ptr<std::mutex> mutex_;
+};
+
+} // namespace ECS::detail
@@ -0,0 +1,483 @@
+#pragma once
+
+#include "Component.hpp"
+#include "ComponentStorage.hpp"
+#include "EntityID.hpp"
+#include "System.hpp"
+#include "Type.hpp"
+
+#include <cstddef>
+#include <limits>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ECS {
+
+// Query term matching only entities that have none of Cs. Passes nothing to
+// the system.
+template <Component... Cs> struct Without {};
+
+// Query term that doesn't restrict matching. Passes a pointer to C to the
+// system, or nullptr if the entity doesn't have one.
+template <Component C> struct Optional {};
+
+namespace detail {
+
+// How a single term of a system's query contributes to the masks and the
+// arguments of the system. Plain components are required and passed by
+// reference.
+template <typename T> struct QueryTerm {
+  using C = std::remove_cv_t<T>;
+  using Args = std::tuple<T &>;
+
+  template <Component... Cs>
+  constexpr static bool valid_for = contains_v<C, Cs...>;
+
+  template <Component... Cs> constexpr static Type<Cs...> required() {
+    return TypeFor<Cs...>::template getType<C>();
+  }
+
+  template <Component... Cs> constexpr static Type<Cs...> excluded() {
+    return {};
+  }
+
+  // Without Journal, writes aren't journaled for snapshots
+  template <bool Journal = true, Component... Cs>
+  constexpr static Args fetch(ComponentStorage<Cs...> &storage,
+                              Type<Cs...> const &, size_t i) {
+    // Read-only terms leave the pages of the storage clean for snapshots
+    if constexpr (std::is_const_v<T>)
+      return Args{std::as_const(storage).template get<C>(i)};
+    else if constexpr (Journal)
+      return Args{storage.template get<C>(i)};
+    else
+      return Args{storage.template get_untracked<C>(i)};
+  }
+
+  template <Component... Cs>
+  constexpr static bool available(ComponentStorage<Cs...> &) {
+    return true;
+  }
+};
+
+template <Component... Ws> struct QueryTerm<Without<Ws...>> {
+  using Args = std::tuple<>;
+
+  template <Component... Cs>
+  constexpr static bool valid_for = (contains_v<Ws, Cs...> && ...);
+
+  template <Component... Cs> constexpr static Type<Cs...> required() {
+    return {};
+  }
+
+  template <Component... Cs> constexpr static Type<Cs...> excluded() {
+    auto type = TypeFor<Cs...>::template getType<std::remove_cv_t<Ws>...>();
+    type &= ~TypeFor<Cs...>::template getType<>();
+    return type;
+  }
+
+  template <bool Journal = true, Component... Cs>
+  constexpr static Args fetch(ComponentStorage<Cs...> &, Type<Cs...> const &,
+                              size_t) {
+    return {};
+  }
+
+  template <Component... Cs>
+  constexpr static bool available(ComponentStorage<Cs...> &) {
+    return true;
+  }
+};
+
+template <Component T> struct QueryTerm<Optional<T>> {
+  using C = std::remove_cv_t<T>;
+  using Args = std::tuple<T *>;
+
+  template <Component... Cs>
+  constexpr static bool valid_for = contains_v<C, Cs...>;
+
+  template <Component... Cs> constexpr static Type<Cs...> required() {
+    return {};
+  }
+
+  template <Component... Cs> constexpr static Type<Cs...> excluded() {
+    return {};
+  }
+
+  template <bool Journal = true, Component... Cs>
+  constexpr static Args fetch(ComponentStorage<Cs...> &storage,
+                              Type<Cs...> const &type, size_t i) {
+    if (!type.test(index_for<C, Cs...>))
+      return Args{nullptr};
+    if constexpr (std::is_const_v<T>)
+      return Args{&std::as_const(storage).template get<C>(i)};
+    else if constexpr (Journal)
+      return Args{&storage.template get<C>(i)};
+    else
+      return Args{&storage.template get_untracked<C>(i)};
+  }
+
+  template <Component... Cs>
+  constexpr static bool available(ComponentStorage<Cs...> &) {
+    return true;
+  }
+};
+
+// Resources don't take part in matching. A system asking for one only runs
+// while the world has it.
+template <Component T> struct QueryTerm<Resource<T>> {
+  using R = std::remove_cv_t<T>;
+  using Args = std::tuple<T &>;
+
+  template <Component... Cs>
+  constexpr static bool valid_for = contains_v<Resource<R>, Cs...>;
+
+  template <Component... Cs> constexpr static Type<Cs...> required() {
+    return {};
+  }
+
+  template <Component... Cs> constexpr static Type<Cs...> excluded() {
+    return {};
+  }
+
+  template <bool Journal = true, Component... Cs>
+  constexpr static Args fetch(ComponentStorage<Cs...> &storage,
+                              Type<Cs...> const &, size_t) {
+    return Args{*storage.template resource<R>()};
+  }
+
+  template <Component... Cs>
+  constexpr static bool available(ComponentStorage<Cs...> &storage) {
+    return storage.template resource<R>().has_value();
+  }
+};
+
+// EntityID as a query term passes the id of the entity, e.g. for systems that
+// maintain indices like SpatialGrid.
+template <> struct QueryTerm<EntityID> {
+  using Args = std::tuple<EntityID>;
+
+  template <Component... Cs> constexpr static bool valid_for = true;
+
+  template <Component... Cs> constexpr static Type<Cs...> required() {
+    return {};
+  }
+
+  template <Component... Cs> constexpr static Type<Cs...> excluded() {
+    return {};
+  }
+
+  template <bool Journal = true, Component... Cs>
+  constexpr static Args fetch(ComponentStorage<Cs...> &, Type<Cs...> const &,
+                              size_t i) {
+    return Args{EntityID{i}};
+  }
+
+  template <Component... Cs>
+  constexpr static bool available(ComponentStorage<Cs...> &) {
+    return true;
+  }
+};
+
+// How a term is passed to the block form of a system, see Ecs::run. Plain
+// components are copied into a contiguous column and written back after the
+// block unless they are const.
+template <typename T> struct BlockTerm {
+  using C = std::remove_cv_t<T>;
+  using Args = std::tuple<std::span<T>>;
+
+  // Scratch space of one worker, reused across blocks
+  struct Buffer {
+    std::vector<C> values;
+    std::vector<C *> sources;
+  };
+
+  template <bool Journal, Component... Cs>
+  static void gather(Buffer &buffer, ComponentStorage<Cs...> &storage,
+                     Type<Cs...> const &type, size_t i) {
+    auto &c =
+        std::get<0>(QueryTerm<T>::template fetch<Journal>(storage, type, i));
+    buffer.values.push_back(c);
+    if constexpr (!std::is_const_v<T>)
+      buffer.sources.push_back(&c);
+  }
+
+  static Args columns(Buffer &buffer) {
+    return Args{std::span<T>{buffer.values}};
+  }
+
+  static void scatter(Buffer &buffer) {
+    for (auto k = 0uz; k != buffer.sources.size(); ++k)
+      *buffer.sources[k] = std::move(buffer.values[k]);
+    buffer.values.clear();
+    buffer.sources.clear();
+  }
+};
+
+template <Component... Ws> struct BlockTerm<Without<Ws...>> {
+  using Args = std::tuple<>;
+
+  struct Buffer {};
+
+  template <bool Journal, Component... Cs>
+  static void gather(Buffer &, ComponentStorage<Cs...> &, Type<Cs...> const &,
+                     size_t) {}
+
+  static Args columns(Buffer &) { return {}; }
+
+  static void scatter(Buffer &) {}
+};
+
+// Pointers into the storage, nullptr for entities without the component
+template <Component T> struct BlockTerm<Optional<T>> {
+  using Args = std::tuple<std::span<T *const>>;
+
+  struct Buffer {
+    std::vector<T *> pointers;
+  };
+
+  template <bool Journal, Component... Cs>
+  static void gather(Buffer &buffer, ComponentStorage<Cs...> &storage,
+                     Type<Cs...> const &type, size_t i) {
+    buffer.pointers.push_back(std::get<0>(
+        QueryTerm<Optional<T>>::template fetch<Journal>(storage, type, i)));
+  }
+
+  static Args columns(Buffer &buffer) {
+    return Args{std::span<T *const>{buffer.pointers}};
+  }
+
+  static void scatter(Buffer &buffer) { buffer.pointers.clear(); }
+};
+
+// Resources are passed once per block
+template <Component T> struct BlockTerm<Resource<T>> {
+  using Args = std::tuple<T &>;
+
+  struct Buffer {
+    T *resource{};
+  };
+
+  template <bool Journal, Component... Cs>
+  static void gather(Buffer &buffer, ComponentStorage<Cs...> &storage,
+                     Type<Cs...> const &type, size_t i) {
+    buffer.resource =
+        &std::get<0>(QueryTerm<Resource<T>>::fetch(storage, type, i));
+  }
+
+  static Args columns(Buffer &buffer) { return Args{*buffer.resource}; }
+
+  static void scatter(Buffer &) {}
+};
+
+template <> struct BlockTerm<EntityID> {
+  using Args = std::tuple<std::span<EntityID const>>;
+
+  struct Buffer {
+    std::vector<EntityID> ids;
+  };
+
+  template <bool Journal, Component... Cs>
+  static void gather(Buffer &buffer, ComponentStorage<Cs...> &storage,
+                     Type<Cs...> const &type, size_t i) {
+    buffer.ids.push_back(
+        std::get<0>(QueryTerm<EntityID>::fetch(storage, type, i)));
+  }
+
+  static Args columns(Buffer &buffer) {
+    return Args{std::span<EntityID const>{buffer.ids}};
+  }
+
+  static void scatter(Buffer &buffer) { buffer.ids.clear(); }
+};
+
+// A whole query, folded into one required and one excluded mask so matching
+// an entity is a single masked compare.
+template <typename... Ts> struct Query {
+  using Args = decltype(std::tuple_cat(
+      std::declval<typename QueryTerm<Ts>::Args>()...));
+
+  // Queries of only resources run once instead of once per entity
+  constexpr static bool resources_only =
+      sizeof...(Ts) != 0 && (is_resource_v<Ts> && ...);
+
+  template <Component... Cs>
+  constexpr static bool valid_for = (QueryTerm<Ts>::template valid_for<Cs...> &&
+                                     ...);
+
+  template <Component... Cs>
+  constexpr static Type<Cs...> required =
+      (TypeFor<Cs...>::template getType<>() | ... |
+       QueryTerm<Ts>::template required<Cs...>());
+
+  template <Component... Cs>
+  constexpr static Type<Cs...> excluded =
+      (Type<Cs...>{} | ... | QueryTerm<Ts>::template excluded<Cs...>());
+
+  template <Component... Cs>
+  constexpr static bool matches(Type<Cs...> const &type) {
+    return detail::matches<required<Cs...>, excluded<Cs...>>(type);
+  }
+
+  // Whether all resources the query asks for exist
+  template <Component... Cs>
+  constexpr static bool available(
+      [[maybe_unused]] ComponentStorage<Cs...> &storage) {
+    return (QueryTerm<Ts>::available(storage) && ...);
+  }
+
+  template <bool Journal = true, Component... Cs>
+  constexpr static Args fetch([[maybe_unused]] ComponentStorage<Cs...> &storage,
+                              [[maybe_unused]] Type<Cs...> const &type,
+                              [[maybe_unused]] size_t i) {
+    return std::tuple_cat(
+        QueryTerm<Ts>::template fetch<Journal>(storage, type, i)...);
+  }
+
+  // Block form: gather() appends entity i to the buffers, columns() passes
+  // everything gathered to the system and scatter() writes it back
+  using BlockArgs = decltype(std::tuple_cat(
+      std::declval<typename BlockTerm<Ts>::Args>()...));
+  using BlockBuffers = std::tuple<typename BlockTerm<Ts>::Buffer...>;
+
+  template <bool Journal, Component... Cs>
+  static void gather(BlockBuffers &buffers, ComponentStorage<Cs...> &storage,
+                     Type<Cs...> const &type, size_t i) {
+    std::apply(
+        [&](auto &...buffer) {
+          (BlockTerm<Ts>::template gather<Journal>(buffer, storage, type, i),
+           ...);
+        },
+        buffers);
+  }
+
+  static BlockArgs columns(BlockBuffers &buffers) {
+    return std::apply(
+        [](auto &...buffer) {
+          return std::tuple_cat(BlockTerm<Ts>::columns(buffer)...);
+        },
+        buffers);
+  }
+
+  static void scatter(BlockBuffers &buffers) {
+    std::apply([](auto &...buffer) { (BlockTerm<Ts>::scatter(buffer), ...); },
+               buffers);
+  }
+};
+
+// Dense list of the entities matching a registered query. Kept up to date on
+// every structural change of the world by comparing the old and new Type of
+// the entity, so running the query needs no filtering.
+template <typename Type> class MatchList {
+  constexpr static auto empty_cell = std::numeric_limits<size_t>::max();
+
+public:
+  constexpr MatchList(Type required, Type excluded)
+      : required_{required}, relevant_{required | excluded} {}
+
+  constexpr bool matches(Type const &type) const {
+    return (type & relevant_) == required_;
+  }
+
+  constexpr void update(size_t i, Type const &old_type, Type const &new_type) {
+    const auto was = matches(old_type);
+    const auto is = matches(new_type);
+    if (was == is)
+      return;
+
+    if (is)
+      add(i);
+    else
+      remove(i);
+  }
+
+  constexpr void clear() {
+    entities_.clear();
+    positions_.clear();
+  }
+
+  constexpr std::vector<size_t> const &entities() const { return entities_; }
+
+  constexpr size_t bytes() const {
+    return (entities_.capacity() + positions_.capacity()) * sizeof(size_t);
+  }
+
+private:
+  constexpr void add(size_t i) {
+    if (i >= positions_.size())
+      positions_.resize(i + 1, empty_cell);
+
+    positions_[i] = entities_.size();
+    entities_.push_back(i);
+  }
+
+  constexpr void remove(size_t i) {
+    const auto position = positions_[i];
+    const auto last = entities_.back();
+
+    entities_[position] = last;
+    positions_[last] = position;
+    entities_.pop_back();
+    positions_[i] = empty_cell;
+  }
+
+  Type required_;
+  Type relevant_;
+  std::vector<size_t> entities_;
+  std::vector<size_t> positions_;
+};
+
+// Whether s can be called with the arguments in the tuple Args. Unlike
+// checking std::apply, this fails softly on a mismatched run signature.
+template <typename S, typename Args> constexpr bool invocable_with = false;
+
+template <typename S, typename... As>
+constexpr bool invocable_with<S, std::tuple<As...>> =
+    std::is_invocable_v<S const &, As...>;
+
+// Whether s.block(args...) accepts the arguments in the tuple Args
+template <typename S, typename Args>
+constexpr bool block_invocable_with = false;
+
+template <typename S, typename... As>
+constexpr bool block_invocable_with<S, std::tuple<As...>> =
+    requires(S const &s, As... as) { s.block(as...); };
+
+template <typename Derived, typename... Ts>
+Query<Ts...> query_of(BaseSystem<Derived, Ts...> const &);
+
+// The query a BaseSystem was declared with
+template <typename S>
+using QueryOf = decltype(query_of(std::declval<S const &>()));
+
+} // namespace detail
+
+// Handle to a query registered with Ecs::register_query. Running it iterates
+// only the entities currently matching Ts. Only valid for the world that
+// registered it.
+template <Component... Ts> class CachedQuery {
+public:
+  template <Component...> friend class Ecs;
+
+private:
+  constexpr CachedQuery(void const *world, size_t index)
+      : world_{world}, index_{index} {}
+
+  void const *world_;
+  size_t index_;
+};
+
+// A system that can be called with the arguments produced by the query Ts
+template <typename S, typename... Ts>
+concept QuerySystem =
+    detail::invocable_with<S, typename detail::Query<Ts...>::Args>;
+
+// A system with a block form for the query Ts, see BaseSystem
+template <typename S, typename... Ts>
+concept BlockSystem =
+    !detail::Query<Ts...>::resources_only &&
+    detail::block_invocable_with<S, typename detail::Query<Ts...>::BlockArgs>;
+
+} // namespace ECS
@@ -0,0 +1,230 @@
+#pragma once
+
+#include "Component.hpp"
+#include "PageJournal.hpp"
+#include "ecs.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <optional>
+#include <queue>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ECS {
+
+namespace detail {
+// Storages keep the pages changed after a snapshot, resources are small and
+// copied whole at the snapshot
+template <typename C> struct FrameState {
+  using type = typename SparseSet<C>::Checkpoint;
+};
+
+template <typename R> struct FrameState<Resource<R>> {
+  using type = std::optional<R>;
+};
+
+template <typename C> using FrameStateFor = typename FrameState<C>::type;
+} // namespace detail
+
+// Ring of the last `capacity` states of a world, for rollback. The world
+// journals the pages of its type array and storages on their first write
+// after each capture, so a capture only costs copying the pages written in
+// the tick before it, and rolling back only copies those pages back.
+//
+// Requires trivially copyable components. Resources are copied whole.
+// Registered queries are updated for the entities whose types changed.
+// Snapshots don't survive evicting or loading cold entities: rollback then
+// fails and empties the ring.
+//
+// A world has at most one ring, which must not outlive it or see it moved.
+template <Component... Cs> class SnapshotRing {
+  static_assert((std::is_trivially_copyable_v<Cs> && ...),
+                "Snapshots copy components bytewise");
+
+  using World = Ecs<Cs...>;
+  using Type = typename World::Type;
+  using Log = detail::PageJournal::Log;
+
+  // A capture, and the pages the world changed between it and the next one
+  struct Frame {
+    Log types;
+    std::tuple<detail::FrameStateFor<Cs>...> storages;
+    std::queue<size_t> free_ids;
+    size_t cold_generation{};
+  };
+
+public:
+  explicit SnapshotRing(size_t capacity) : frames_(capacity) {
+    assert(capacity > 0);
+  }
+
+  SnapshotRing(SnapshotRing const &) = delete;
+  SnapshotRing &operator=(SnapshotRing const &) = delete;
+
+  ~SnapshotRing() {
+    if (!world_)
+      return;
+    world_->journaled_ = false;
+    world_->types_journal_.stop();
+    world_->for_each_component([&]<Component C>() {
+      world_->components_.template storage<C>().stop_journal();
+    });
+  }
+
+  size_t size() const { return size_; }
+
+  // Records the current state of world as the newest snapshot, replacing the
+  // oldest one if the ring is full.
+  void capture(World &world) {
+    assert(!world_ || world_ == &world);
+    world_ = &world;
+    world.journaled_ = true;
+
+    // Closes the epoch of the previous capture
+    Frame changes;
+    checkpoint(world, size_ == 0 ? changes : frames_[head_]);
+
+    head_ = (head_ + 1) % frames_.size();
+    auto &newest = frames_[head_];
+    newest = {};
+    (capture_resource<Cs>(world, newest), ...);
+    newest.free_ids = world.free_ids_;
+    newest.cold_generation = world.cold_generation_;
+    size_ = std::min(size_ + 1, frames_.size());
+  }
+
+  // Restores world to the snapshot taken `ticks` captures ago, 0 being the
+  // newest. Newer snapshots are dropped. Returns false if there is no such
+  // snapshot, or if entities were evicted or loaded since, which also drops
+  // all snapshots.
+  bool rollback(World &world, size_t ticks) {
+    if (ticks >= size_)
+      return false;
+    assert(world_ == &world);
+
+    auto &target = frame(ticks);
+    if (target.cold_generation != world.cold_generation_) {
+      size_ = 0;
+      return false;
+    }
+
+    Frame open;
+    checkpoint(world, open);
+
+    // Types of the entities the undone pages may change, before the undo
+    std::vector<std::pair<size_t, Type>> old_types;
+    if (!world.queries_.empty())
+      old_types = touched_types(world, open, ticks);
+
+    undo(world, open);
+    for (auto k = 1uz; k <= ticks; ++k)
+      undo(world, frame(k));
+
+    (restore_resource<Cs>(world, target), ...);
+    world.free_ids_ = target.free_ids;
+
+    for (auto &query : world.queries_)
+      for (auto const &[i, old_type] : old_types)
+        query.update(i, old_type,
+                     i < world.types_.size() ? world.types_[i] : Type{});
+
+    head_ = index(ticks);
+    size_ -= ticks;
+
+    // The target is the newest capture again, and its epoch starts over
+    checkpoint(world, open);
+    target.types = {};
+    world.for_each_component([&]<Component C>() {
+      std::get<detail::FrameStateFor<C>>(target.storages) = {};
+    });
+
+    return true;
+  }
+
+private:
+  // Starts a new epoch of every journal of world, and moves the pages of the
+  // one it ends into frame
+  static void checkpoint(World &world, Frame &frame) {
+    frame.types =
+        world.types_journal_.checkpoint(world.types_.size() * sizeof(Type));
+    world.for_each_component([&]<Component C>() {
+      std::get<detail::FrameStateFor<C>>(frame.storages) =
+          world.components_.template storage<C>().checkpoint();
+    });
+  }
+
+  static void undo(World &world, Frame const &frame) {
+    world.types_.resize(frame.types.size / sizeof(Type));
+    detail::PageJournal::undo(frame.types,
+                              std::as_writable_bytes(std::span{world.types_}));
+    world.for_each_component([&]<Component C>() {
+      world.components_.template storage<C>().undo(
+          std::get<detail::FrameStateFor<C>>(frame.storages));
+    });
+  }
+
+  // Entities in the type pages written since `ticks` captures ago, and those
+  // created since
+  std::vector<std::pair<size_t, Type>>
+  touched_types(World const &world, Frame const &open, size_t ticks) const {
+    auto const &types = world.types_;
+    auto const &target_log = ticks == 0 ? open.types : frame(ticks).types;
+    const auto target_size =
+        std::min(types.size(), target_log.size / sizeof(Type));
+
+    std::vector<size_t> pages = open.types.pages;
+    for (auto k = 1uz; k <= ticks; ++k) {
+      auto const &logged = frame(k).types.pages;
+      pages.insert(pages.end(), logged.begin(), logged.end());
+    }
+    std::ranges::sort(pages);
+    pages.erase(std::ranges::unique(pages).begin(), pages.end());
+
+    std::vector<std::pair<size_t, Type>> touched;
+    constexpr auto page_size = detail::PageJournal::page_size;
+    for (const auto p : pages) {
+      const auto first = p * page_size / sizeof(Type);
+      const auto last = std::min(
+          ((p + 1) * page_size + sizeof(Type) - 1) / sizeof(Type), target_size);
+      for (auto i = first; i < last; ++i)
+        touched.emplace_back(i, types[i]);
+    }
+    for (auto i = target_size; i < types.size(); ++i)
+      touched.emplace_back(i, types[i]);
+    return touched;
+  }
+
+  // The frame captured `ticks` captures ago
+  Frame &frame(size_t ticks) { return frames_[index(ticks)]; }
+  Frame const &frame(size_t ticks) const { return frames_[index(ticks)]; }
+
+  size_t index(size_t ticks) const {
+    return (head_ + frames_.size() - ticks) % frames_.size();
+  }
+
+  template <Component C>
+  static void capture_resource(World &world, Frame &frame) {
+    if constexpr (is_resource_v<C>)
+      std::get<detail::FrameStateFor<C>>(frame.storages) =
+          world.components_.template resource<typename C::type>();
+  }
+
+  template <Component C>
+  static void restore_resource(World &world, Frame const &target) {
+    if constexpr (is_resource_v<C>)
+      world.components_.template resource<typename C::type>() =
+          std::get<detail::FrameStateFor<C>>(target.storages);
+  }
+
+  std::vector<Frame> frames_;
+  size_t head_{};
+  size_t size_{};
+  World *world_{};
+};
+
+} // namespace ECS
@@ -1,13 +1,22 @@
 #pragma once
 
+#include <array>
+#include <bit>
 #include <cassert>
+#include <concepts>
 #include <cstddef>
 #include <iterator>
 #include <limits>
+#include <span>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#include "Numa.hpp"
+#include "PageJournal.hpp"
+
 template <typename C> class SparseSet {
+  template <typename> friend class SparseSet;
 
   struct Entry {
     size_t backlink;
@@ -17,19 +26,49 @@ template <typename C> class SparseSet {
 public:
   constexpr static auto empty_cell = std::numeric_limits<size_t>::max();
 
+  // Bytes a component takes in dense storage
+  constexpr static auto entry_size = sizeof(Entry);
+
   constexpr void reserve(size_t new_size) {
     if (new_size > sparse.size())
       sparse.resize(new_size, empty_cell);
   }
 
+  // Grows like reserve, but leaves the new sparse cells and the dense capacity
+  // untouched so they can be placed by first touch. The caller must
+  // clear_slot every new cell before using the set.
+  constexpr void reserve_untouched(size_t new_size, size_t dense_capacity) {
+    if (new_size > sparse.size())
+      sparse.resize(new_size);
+    dense.reserve(dense_capacity);
+  }
+
+  constexpr void clear_slot(size_t i) {
+    touch_sparse(i);
+    sparse[i] = empty_cell;
+  }
+
+  std::span<std::byte> sparse_memory() {
+    return std::as_writable_bytes(std::span{sparse});
+  }
+
+  // Allocated but unused dense storage
+  std::span<std::byte> spare_dense_memory() {
+    return {reinterpret_cast<std::byte *>(dense.data() + dense.size()),
+            (dense.capacity() - dense.size()) * sizeof(Entry)};
+  }
+
   constexpr void add(size_t i, C c) {
     assert(i < sparse.size());
 
     if (sparse[i] < dense.size()) {
-      dense[sparse[i]] = Entry{sparse[i], std::move(c)};
+      touch_dense(sparse[i]);
+      dense[sparse[i]].data = std::move(c);
     } else {
+      touch_sparse(i);
+      touch_dense(dense.size());
       sparse[i] = dense.size();
-      dense.emplace_back(dense.size(), std::move(c));
+      dense.emplace_back(i, std::move(c));
     }
   }
 
@@ -38,24 +77,235 @@ public:
     if (sparse[i] >= dense.size())
       return;
 
-    std::swap(dense[sparse[i]], dense.back());
-    dense.pop_back();
+    const auto slot = sparse[i];
+    const auto owner = dense.back().backlink;
+    assert(sparse[owner] == dense.size() - 1);
 
-    const auto owner = dense[sparse[i]].backlink;
-    assert(sparse[owner] == dense.size());
+    touch_dense(slot);
+    touch_dense(dense.size() - 1);
+    touch_sparse(owner);
+    touch_sparse(i);
+    std::swap(dense[slot], dense.back());
+    dense.pop_back();
 
-    sparse[owner] = sparse[i];
+    sparse[owner] = slot;
     sparse[i] = empty_cell;
   }
 
-  template <typename Self> constexpr auto &get(this Self &self, size_t i) {
-    assert(i < self.sparse.size());
-    assert(self.sparse[i] < self.dense.size());
+  // Handing out a mutable reference counts as a write
+  constexpr C &get(size_t i) {
+    assert(i < sparse.size());
+    assert(sparse[i] < dense.size());
+
+    touch_dense(sparse[i]);
+    return dense[sparse[i]].data;
+  }
+
+  // Like get, but leaves journaling the write to the caller
+  constexpr C &get_untracked(size_t i) {
+    assert(i < sparse.size());
+    assert(sparse[i] < dense.size());
+
+    return dense[sparse[i]].data;
+  }
+
+  constexpr C const &get(size_t i) const {
+    assert(i < sparse.size());
+    assert(sparse[i] < dense.size());
+
+    return dense[sparse[i]].data;
+  }
+
+  constexpr bool contains(size_t i) const {
+    return i < sparse.size() && sparse[i] < dense.size();
+  }
+
+  constexpr size_t size() const { return dense.size(); }
+
+  constexpr size_t capacity() const { return dense.capacity(); }
+
+  // Number of entity ids the sparse array covers
+  constexpr size_t id_capacity() const { return sparse.size(); }
+
+  // Releases dense storage once less than half of it is in use
+  void shrink() {
+    if (dense.size() < dense.capacity() / 2)
+      dense.shrink_to_fit();
+  }
+
+  constexpr size_t sparse_bytes() const {
+    return sparse.capacity() * sizeof(size_t);
+  }
+
+  constexpr size_t dense_bytes() const {
+    return dense.capacity() * sizeof(Entry);
+  }
+
+  size_t journal_bytes() const {
+    return sparse_journal.bytes() + dense_journal.bytes();
+  }
+
+  // Bulk loading: grow() appends `count` placeholder entries and returns the
+  // index of the first, assign() then fills them. Placeholders are default
+  // initialized, so for trivial components their pages are first touched by
+  // the assigning threads. Distinct slots and ids may be assigned from
+  // different threads.
+  constexpr size_t grow(size_t count)
+    requires std::default_initializable<C>
+  {
+    const auto first = dense.size();
+    dense.resize(first + count);
+    return first;
+  }
+
+  constexpr void assign(size_t slot, size_t i, C c) {
+    assert(i < sparse.size());
+    assert(slot < dense.size());
+
+    touch_dense(slot);
+    touch_sparse(i);
+    dense[slot] = Entry{i, std::move(c)};
+    sparse[i] = slot;
+  }
+
+  // Hints for batched lookups: prefetch_slot pulls in the sparse entry of i,
+  // prefetch_data the dense entry it points to.
+  constexpr void prefetch_slot(size_t i) const {
+    if (i < sparse.size())
+      __builtin_prefetch(sparse.data() + i);
+  }
+
+  constexpr void prefetch_data(size_t i) const {
+    if (contains(i))
+      __builtin_prefetch(dense.data() + sparse[i]);
+  }
+
+  // Moves at most `budget` entries of the dense array into entity id order.
+  // Passes are resumable: call repeatedly until it returns true.
+  constexpr bool sort_step(size_t budget) {
+    start_pass(this);
+    while (budget != 0 && sort_source < sparse.size() &&
+           sort_cursor < dense.size()) {
+      const auto id = sort_source++;
+      --budget;
+      if (sparse[id] >= dense.size())
+        continue;
+      swap_slots(sort_cursor++, sparse[id]);
+    }
+    return finish_pass(sparse.size());
+  }
+
+  // Like sort_step, but orders the dense array like `order`'s. Entities not
+  // present in `order` end up behind those that are.
+  template <typename D>
+  constexpr bool sort_step(SparseSet<D> const &order, size_t budget) {
+    start_pass(&order);
+    while (budget != 0 && sort_source < order.dense.size() &&
+           sort_cursor < dense.size()) {
+      const auto id = order.dense[sort_source++].backlink;
+      --budget;
+      if (!contains(id))
+        continue;
+      swap_slots(sort_cursor++, sparse[id]);
+    }
+    return finish_pass(order.dense.size());
+  }
+
+  // Pages of both arrays as of a checkpoint
+  struct Checkpoint {
+    ECS::detail::PageJournal::Log sparse;
+    ECS::detail::PageJournal::Log dense;
+  };
+
+  // Starts journaling the pages that writes change from now on, and returns
+  // the pages changed since the previous checkpoint
+  Checkpoint checkpoint()
+    requires std::is_trivially_copyable_v<C>
+  {
+    return {sparse_journal.checkpoint(sparse.size() * sizeof(size_t)),
+            dense_journal.checkpoint(dense.size() * sizeof(Entry))};
+  }
+
+  // Takes the set back to the state of the checkpoint that `checkpoint` was
+  // returned by. Undo the checkpoints in the reverse order they were taken.
+  void undo(Checkpoint const &checkpoint)
+    requires std::is_trivially_copyable_v<C>
+  {
+    sparse.resize(checkpoint.sparse.size / sizeof(size_t));
+    ECS::detail::PageJournal::undo(checkpoint.sparse,
+                                   std::as_writable_bytes(std::span{sparse}));
+
+    // Entries may not be default constructible, and the pages overwrite the
+    // placeholders anyway
+    const auto dense_size = checkpoint.dense.size / sizeof(Entry);
+    if (dense.size() > dense_size)
+      dense.erase(dense.begin() + static_cast<std::ptrdiff_t>(dense_size),
+                  dense.end());
+    while (dense.size() < dense_size)
+      dense.push_back(
+          std::bit_cast<Entry>(std::array<std::byte, sizeof(Entry)>{}));
+    ECS::detail::PageJournal::undo(checkpoint.dense,
+                                   std::as_writable_bytes(std::span{dense}));
+
+    sort_source = 0;
+    sort_cursor = 0;
+  }
 
-    return self.dense[self.sparse[i]].data;
+  void stop_journal() {
+    sparse_journal.stop();
+    dense_journal.stop();
   }
 
 private:
-  std::vector<size_t> sparse;
-  std::vector<Entry> dense;
+  constexpr void swap_slots(size_t a, size_t b) {
+    if (a == b)
+      return;
+    touch_dense(a);
+    touch_dense(b);
+    touch_sparse(dense[a].backlink);
+    touch_sparse(dense[b].backlink);
+    std::swap(dense[a], dense[b]);
+    sparse[dense[a].backlink] = a;
+    sparse[dense[b].backlink] = b;
+  }
+
+  // Call before writing a cell of either array
+  constexpr void touch_sparse(size_t i) {
+    sparse_journal.touch(std::as_bytes(std::span{sparse}), i * sizeof(size_t),
+                         sizeof(size_t));
+  }
+
+  constexpr void touch_dense(size_t slot) {
+    dense_journal.touch(std::as_bytes(std::span{dense}), slot * sizeof(Entry),
+                        sizeof(Entry));
+  }
+
+  // Starts over if the pass in progress sorted by another key
+  constexpr void start_pass(void const *key) {
+    if (key == sort_key)
+      return;
+    sort_key = key;
+    sort_source = 0;
+    sort_cursor = 0;
+  }
+
+  constexpr bool finish_pass(size_t source_size) {
+    if (sort_source < source_size && sort_cursor < dense.size())
+      return false;
+    sort_source = 0;
+    sort_cursor = 0;
+    return true;
+  }
+
+  std::vector<size_t, ECS::detail::DefaultInitAllocator<size_t>> sparse;
+  std::vector<Entry, ECS::detail::DefaultInitAllocator<Entry>> dense;
+
+  ECS::detail::PageJournal sparse_journal;
+  ECS::detail::PageJournal dense_journal;
+
+  // Progress of the current incremental sort pass, and the set it sorts by,
+  // this one for entity id order
+  void const *sort_key{};
+  size_t sort_source{};
+  size_t sort_cursor{};
 };
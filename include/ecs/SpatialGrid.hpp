@@ -0,0 +1,261 @@
+#pragma once
+
+#include "Component.hpp"
+#include "EntityID.hpp"
+#include "System.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ECS {
+
+struct Aabb {
+  float min_x, min_y, max_x, max_y;
+
+  constexpr bool overlaps(Aabb const &other) const {
+    return min_x <= other.max_x && other.min_x <= max_x &&
+           min_y <= other.max_y && other.min_y <= max_y;
+  }
+};
+
+// Uniform grid broadphase. Each entity is bucketed into every cell its box
+// touches; moving an entity only touches the buckets when it changes cells.
+// Keep it up to date with GridSync, and have it forget entities that lose
+// their component or are removed with remove_on. Evicting an entity doesn't
+// remove it.
+//
+// Not thread-safe. Pick a cell size around the size of a typical body.
+class SpatialGrid {
+  struct CellRange {
+    std::int32_t x0, y0, x1, y1;
+
+    constexpr bool operator==(CellRange const &) const = default;
+  };
+
+  struct Record {
+    Aabb box;
+    CellRange cells;
+    bool present;
+  };
+
+public:
+  explicit SpatialGrid(float cell_size) : cell_size_{cell_size} {
+    assert(cell_size > 0);
+  }
+
+  void update(EntityID id, Aabb const &box) {
+    const auto i = id.value_;
+    if (i >= records_.size()) {
+      records_.resize(i + 1);
+      visited_.resize(i + 1);
+    }
+
+    auto &record = records_[i];
+    const auto cells = cells_for(box);
+    record.box = box;
+
+    if (record.present && record.cells == cells)
+      return;
+
+    if (record.present)
+      unlink(i, record.cells);
+    else
+      ++size_;
+
+    record.cells = cells;
+    record.present = true;
+    for_each_cell(cells, [&](std::int32_t x, std::int32_t y) {
+      cells_[key(x, y)].push_back(i);
+    });
+  }
+
+  void remove(EntityID id) {
+    const auto i = id.value_;
+    if (i >= records_.size() || !records_[i].present)
+      return;
+
+    unlink(i, records_[i].cells);
+    records_[i].present = false;
+    --size_;
+  }
+
+  size_t size() const { return size_; }
+
+  // Removes entities when C, the component their boxes come from, is removed
+  // from them, or when they are removed from world. The grid must outlive
+  // world.
+  template <Component C, typename World> void remove_on(World &world) {
+    world.template on_remove<C>([this](EntityID id, C &) { remove(id); });
+  }
+
+  // Calls f with every entity whose box overlaps `box`, once each.
+  template <std::invocable<EntityID> F> void query(Aabb const &box, F f) {
+    const auto epoch = next_epoch();
+
+    for_each_cell(cells_for(box), [&](std::int32_t x, std::int32_t y) {
+      const auto bucket = cells_.find(key(x, y));
+      if (bucket == cells_.end())
+        return;
+
+      for (const auto i : bucket->second) {
+        if (visited_[i] == epoch)
+          continue;
+        visited_[i] = epoch;
+        if (records_[i].box.overlaps(box))
+          f(EntityID{i});
+      }
+    });
+  }
+
+  // Bulk form of query: calls f(k, id) for every entity overlapping
+  // boxes[k], once per pair and in no particular order. The cells of all
+  // boxes are sorted first, so each bucket is looked up once however many
+  // boxes touch it.
+  template <std::invocable<size_t, EntityID> F>
+  void query(std::span<Aabb const> boxes, F f) {
+    std::vector<CellRange> ranges;
+    std::vector<std::pair<std::uint64_t, size_t>> cells;
+    ranges.reserve(boxes.size());
+    for (auto k = 0uz; k != boxes.size(); ++k) {
+      ranges.push_back(cells_for(boxes[k]));
+      for_each_cell(ranges.back(), [&](std::int32_t x, std::int32_t y) {
+        cells.emplace_back(key(x, y), k);
+      });
+    }
+    std::ranges::sort(cells);
+
+    for (auto first = 0uz; first != cells.size();) {
+      const auto cell = cells[first].first;
+      auto last = first;
+      while (last != cells.size() && cells[last].first == cell)
+        ++last;
+
+      const auto bucket = cells_.find(cell);
+      if (bucket != cells_.end()) {
+        const auto [x, y] = coordinates(cell);
+        for (auto c = first; c != last; ++c) {
+          const auto k = cells[c].second;
+          for (const auto i : bucket->second) {
+            // Pairs sharing several cells are only reported from the first
+            auto const &record = records_[i];
+            if (x != std::max(ranges[k].x0, record.cells.x0) ||
+                y != std::max(ranges[k].y0, record.cells.y0))
+              continue;
+
+            if (record.box.overlaps(boxes[k]))
+              f(k, EntityID{i});
+          }
+        }
+      }
+      first = last;
+    }
+  }
+
+  // Calls f once for every pair of entities whose boxes overlap.
+  template <std::invocable<EntityID, EntityID> F> void overlaps(F f) const {
+    for (auto const &[cell, entities] : cells_) {
+      const auto [x, y] = coordinates(cell);
+
+      for (auto a = 0uz; a != entities.size(); ++a) {
+        for (auto b = a + 1; b != entities.size(); ++b) {
+          auto const &ra = records_[entities[a]];
+          auto const &rb = records_[entities[b]];
+
+          // Pairs sharing several cells are only reported from the first
+          if (x != std::max(ra.cells.x0, rb.cells.x0) ||
+              y != std::max(ra.cells.y0, rb.cells.y0))
+            continue;
+
+          if (ra.box.overlaps(rb.box))
+            f(EntityID{entities[a]}, EntityID{entities[b]});
+        }
+      }
+    }
+  }
+
+private:
+  CellRange cells_for(Aabb const &box) const {
+    const auto cell = [this](float v) {
+      return static_cast<std::int32_t>(std::floor(v / cell_size_));
+    };
+    return {cell(box.min_x), cell(box.min_y), cell(box.max_x),
+            cell(box.max_y)};
+  }
+
+  static std::uint64_t key(std::int32_t x, std::int32_t y) {
+    return (std::uint64_t{static_cast<std::uint32_t>(x)} << 32) |
+           static_cast<std::uint32_t>(y);
+  }
+
+  static std::pair<std::int32_t, std::int32_t> coordinates(std::uint64_t key) {
+    return {static_cast<std::int32_t>(key >> 32),
+            static_cast<std::int32_t>(key & 0xffff'ffff)};
+  }
+
+  static void for_each_cell(CellRange const &cells, auto f) {
+    for (auto x = cells.x0; x <= cells.x1; ++x)
+      for (auto y = cells.y0; y <= cells.y1; ++y)
+        f(x, y);
+  }
+
+  void unlink(size_t i, CellRange const &cells) {
+    for_each_cell(cells, [&](std::int32_t x, std::int32_t y) {
+      const auto bucket = cells_.find(key(x, y));
+      assert(bucket != cells_.end());
+      if (bucket == cells_.end())
+        return;
+
+      auto &entities = bucket->second;
+      const auto it = std::find(entities.begin(), entities.end(), i);
+      assert(it != entities.end());
+      if (it == entities.end())
+        return;
+
+      *it = entities.back();
+      entities.pop_back();
+
+      if (entities.empty())
+        cells_.erase(bucket);
+    });
+  }
+
+  std::uint32_t next_epoch() {
+    if (++epoch_ == 0) {
+      std::fill(visited_.begin(), visited_.end(), 0);
+      epoch_ = 1;
+    }
+    return epoch_;
+  }
+
+  float cell_size_;
+  size_t size_{};
+  std::vector<Record> records_;
+  std::unordered_map<std::uint64_t, std::vector<size_t>> cells_;
+
+  // Deduplicates entities spanning several cells during query
+  std::vector<std::uint32_t> visited_;
+  std::uint32_t epoch_{};
+};
+
+// System keeping grid up to date with the boxes of the entities that have C,
+// computed by box_of. Only moved entities change buckets. Ecs::run only
+// accepts it with the SerialExecutor, as the grid isn't thread-safe.
+template <Component C>
+struct GridSync : BaseSystem<GridSync<C>, EntityID, C const> {
+  constexpr static bool serial = true;
+
+  void run(EntityID id, C const &c) const { grid.update(id, box_of(c)); }
+
+  SpatialGrid &grid;
+  Aabb (*box_of)(C const &);
+};
+
+} // namespace ECS
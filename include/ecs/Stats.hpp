@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <format>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "TypeName.hpp"
+
+namespace ECS {
+
+// Occupancy and memory use of a single component storage. Byte counts are
+// what the storage has allocated, not what it currently uses.
+struct StorageStats {
+  std::string_view component;
+  size_t sparse_bytes;
+  size_t dense_bytes;
+  // Components stored and dense slots allocated
+  size_t size;
+  size_t capacity;
+  // Entity ids the sparse array covers, and how many of them have no component
+  size_t sparse_size;
+  size_t holes;
+};
+
+// total_bytes covers the memory the world itself allocates. Left out are
+// snapshots, which their SnapshotRing holds, whatever observer callbacks
+// capture, and heap memory owned by components.
+struct WorldStats {
+  std::vector<StorageStats> storages;
+  size_t types_bytes;
+  size_t query_bytes;
+  // Approximate, the node overhead of the queue isn't counted
+  size_t free_id_bytes;
+  // Dirty page bitmaps and saved pages of the open snapshot epoch
+  size_t journal_bytes;
+  // The observer vectors, not what the callbacks capture
+  size_t observer_bytes;
+  size_t entities;
+  size_t free_ids;
+  // Share of allocated entity ids that are free
+  double fragmentation;
+  // Evicted entities and the size of the file holding them, see Ecs::evict.
+  // Not part of total_bytes.
+  size_t cold_entities;
+  size_t cold_bytes;
+
+  constexpr size_t total_bytes() const {
+    auto total = types_bytes + query_bytes + free_id_bytes + journal_bytes +
+                 observer_bytes;
+    for (auto const &s : storages)
+      total += s.sparse_bytes + s.dense_bytes;
+    return total;
+  }
+};
+
+namespace detail {
+inline std::string json_string(std::string_view s) {
+  std::string result{'"'};
+  for (const auto c : s) {
+    if (c == '"' || c == '\\')
+      result += '\\';
+    result += c;
+  }
+  result += '"';
+  return result;
+}
+} // namespace detail
+
+inline std::string to_json(WorldStats const &stats) {
+  std::string json = std::format(
+      R"({{"total_bytes":{},"types_bytes":{},"query_bytes":{},)"
+      R"("free_id_bytes":{},"journal_bytes":{},"observer_bytes":{},)"
+      R"("entities":{},"free_ids":{},"fragmentation":{},"cold_entities":{},)"
+      R"("cold_bytes":{},"storages":[)",
+      stats.total_bytes(), stats.types_bytes, stats.query_bytes,
+      stats.free_id_bytes, stats.journal_bytes, stats.observer_bytes,
+      stats.entities, stats.free_ids, stats.fragmentation,
+      stats.cold_entities, stats.cold_bytes);
+
+  for (auto const &s : stats.storages) {
+    if (&s != &stats.storages.front())
+      json += ',';
+    json += std::format(
+        R"({{"component":{},"sparse_bytes":{},"dense_bytes":{},"size":{},)"
+        R"("capacity":{},"sparse_size":{},"holes":{}}})",
+        detail::json_string(s.component), s.sparse_bytes, s.dense_bytes,
+        s.size, s.capacity, s.sparse_size, s.holes);
+  }
+
+  json += "]}";
+  return json;
+}
+
+} // namespace ECS
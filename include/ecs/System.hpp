@@ -2,17 +2,97 @@
 
 #include "Component.hpp"
 
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
 namespace ECS {
 template <typename T, typename... Cs>
 concept System = requires(T const &s, Cs &...cs) { s(cs...); };
 
+// Cs are the query terms of the system: components, Without<...>,
+// Optional<...> or EntityID. Derived::run receives the arguments they
+// produce, in order.
+//
+// Alternatively, Derived::run_block(columns...) receives a chunk of matching
+// entities at once: a std::span per component, of copies that are written
+// back unless the term is const, a std::span<T *const> per Optional<T>, a
+// std::span<EntityID const> for EntityID and a reference per resource.
+// Ecs::run prefers it over run, also for cached queries, but fused runs
+// need run. The copies cost memory bandwidth, so the block form only pays
+// off for kernels that are compute bound over the columns.
 template <typename Derived, Component... Cs> struct BaseSystem {
 
-  void operator()(Cs &...cs) const
-    requires requires(Derived const &s, Cs &...cs) { s.run(cs...); }
+  template <typename... Args>
+  void operator()(Args &&...args) const
+    requires requires(Derived const &s, Args &&...as) {
+      s.run(std::forward<Args>(as)...);
+    }
   {
-    static_cast<Derived const *>(this)->run(cs...);
+    static_cast<Derived const *>(this)->run(std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  void block(Args &&...args) const
+    requires requires(Derived const &s, Args &&...as) {
+      s.run_block(std::forward<Args>(as)...);
+    }
+  {
+    static_cast<Derived const *>(this)->run_block(std::forward<Args>(args)...);
   }
 };
 
+// Systems declaring `constexpr static bool serial = true;` update state that
+// isn't thread-safe, and Ecs::run only accepts them with the SerialExecutor
+template <typename S>
+concept SerialSystem = requires { requires S::serial; };
+
+// Systems that fold every matching entity into an accumulator, see
+// Ecs::reduce. Derived::run receives the accumulator followed by the
+// arguments of the query terms Cs, and Derived::combine(Acc &, Acc const &)
+// merges two partial results. Accumulators start out as Derived::identity()
+// if it exists, else value-initialized.
+template <typename Derived, typename Acc, Component... Cs> struct ReduceSystem {
+  using Accumulator = Acc;
+
+  Acc identity_value() const {
+    auto const &derived = static_cast<Derived const &>(*this);
+    if constexpr (requires { derived.identity(); })
+      return derived.identity();
+    else
+      return Acc{};
+  }
+
+  template <typename... Args>
+  void operator()(Acc &acc, Args &&...args) const
+    requires requires(Derived const &s, Acc &a, Args &&...as) {
+      s.run(a, std::forward<Args>(as)...);
+    }
+  {
+    static_cast<Derived const *>(this)->run(acc, std::forward<Args>(args)...);
+  }
+
+  void combine_into(Acc &into, Acc const &from) const {
+    static_cast<Derived const *>(this)->combine(into, from);
+  }
+};
+
+// Several systems run in a single traversal of the world, see fuse()
+template <typename... Ss> struct Fused {
+  std::tuple<Ss...> systems;
+};
+
+// Passing the result to Ecs::run visits every entity once and runs each
+// system that matches it, in order, so a system sees what the earlier ones
+// wrote to the same entity. This gives the same result as running them one
+// after another as long as no system reads components of other entities,
+// e.g. through a view, that an earlier one writes: those may not have been
+// visited yet. Every system needs a run taking the arguments of its query.
+template <typename... Ss>
+  requires(sizeof...(Ss) >= 2)
+constexpr Fused<std::remove_cvref_t<Ss>...> fuse(Ss &&...systems) {
+  return {{std::forward<Ss>(systems)...}};
+}
+
 } // namespace ECS
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "Event.hpp"
+
+namespace ECS::Event {
+
+// Handle to a scheduled event, see EventManager::schedule. Stays safe to
+// cancel after the timer fired or was cancelled.
+struct TimerID {
+  uint32_t index;
+  uint32_t generation;
+};
+
+// Hierarchical timing wheel: four levels of 64 slots, each level 64 times
+// coarser than the one below. Timers are inserted into the slot of the level
+// that covers their distance and moved down a level (cascaded) when the level
+// below wraps around, so scheduling, cancelling and each tick are O(1)
+// amortized. Timers live in a slab and are linked into their slot by index.
+// Timers further out than the wheel covers wait in its last level and are
+// re-inserted as they come closer.
+class TimerWheel {
+public:
+  // Builds the event to deliver, once for each time the timer fires
+  using Factory = std::move_only_function<Event()>;
+
+  TimerWheel() { heads_.fill(none); }
+
+  // The timer first fires on the delay-th tick from now, or the next one for
+  // a delay of 0. A non-zero period makes it fire again every period ticks.
+  TimerID schedule(uint64_t delay, uint64_t period, Factory make);
+
+  // Returns whether the timer was still pending
+  bool cancel(TimerID id) noexcept;
+
+  // Advances time by n ticks and appends the events that became due to out
+  void advance(uint64_t n, std::vector<Event> &out);
+
+  // Pending timers
+  size_t size() const noexcept { return active_; }
+
+private:
+  constexpr static auto bits = 6u;
+  constexpr static auto slots = 1u << bits;
+  constexpr static auto levels = 4u;
+  constexpr static uint64_t mask = slots - 1;
+  constexpr static uint64_t max_delta = (1ull << (bits * levels)) - 1;
+  constexpr static auto none = UINT32_MAX;
+
+  struct Node {
+    uint64_t expires;
+    uint64_t period;
+    Factory make;
+    // Neighbours in the slot list, and the slot as level * slots + index
+    uint32_t prev;
+    uint32_t next;
+    uint32_t slot;
+    uint32_t generation;
+    bool active;
+  };
+
+  // Links timer i into the slot matching its distance from base_
+  void insert(uint32_t i);
+
+  void unlink(uint32_t i) noexcept;
+
+  void release(uint32_t i) noexcept;
+
+  // Re-inserts the timers of one slot of a level, returns the slot index
+  uint64_t cascade(unsigned level, uint64_t index);
+
+  std::array<uint32_t, levels * slots> heads_;
+  std::vector<Node> nodes_;
+  uint32_t free_{none};
+  // The next tick to process
+  uint64_t base_{};
+  size_t active_{};
+};
+
+} // namespace ECS::Event
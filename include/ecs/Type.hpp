@@ -2,15 +2,102 @@
 
 #include "Component.hpp"
 
-#include <bitset>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
 
 namespace ECS::detail {
-template <Component... Cs> using Type = std::bitset<sizeof...(Cs) + 1>;
+
+// Fixed-size bit mask spread over as many 64 bit words as needed. Unlike
+// std::bitset it is usable as a template argument, which lets query matching
+// be specialized on the words a query actually uses (see contains()).
+template <size_t Bits> struct Mask {
+  using Word = std::uint64_t;
+
+  constexpr static auto word_bits = 64uz;
+  constexpr static auto word_count = (Bits + word_bits - 1) / word_bits;
+
+  constexpr Mask &set(size_t bit) {
+    words[bit / word_bits] |= Word{1} << (bit % word_bits);
+    return *this;
+  }
+
+  constexpr bool test(size_t bit) const {
+    return (words[bit / word_bits] >> (bit % word_bits)) & 1;
+  }
+
+  constexpr Mask &operator|=(Mask const &other) {
+    for (auto w = 0uz; w != word_count; ++w)
+      words[w] |= other.words[w];
+    return *this;
+  }
+
+  constexpr Mask &operator&=(Mask const &other) {
+    for (auto w = 0uz; w != word_count; ++w)
+      words[w] &= other.words[w];
+    return *this;
+  }
+
+  constexpr Mask operator~() const {
+    Mask result;
+    for (auto w = 0uz; w != word_count; ++w)
+      result.words[w] = ~words[w];
+    if constexpr (Bits % word_bits != 0)
+      result.words.back() &= (Word{1} << (Bits % word_bits)) - 1;
+    return result;
+  }
+
+  friend constexpr Mask operator|(Mask lhs, Mask const &rhs) {
+    return lhs |= rhs;
+  }
+
+  friend constexpr Mask operator&(Mask lhs, Mask const &rhs) {
+    return lhs &= rhs;
+  }
+
+  constexpr bool operator==(Mask const &) const = default;
+
+  std::array<Word, word_count> words{};
+};
+
+template <auto Required, auto Excluded, size_t W, size_t Bits>
+constexpr bool word_matches(Mask<Bits> const &mask) {
+  constexpr auto relevant = Required.words[W] | Excluded.words[W];
+  if constexpr (relevant == 0)
+    return true;
+  else
+    return (mask.words[W] & relevant) == Required.words[W];
+}
+
+// Whether mask has all bits of Required and none of Excluded. Only the words
+// that either has bits in are loaded and compared.
+template <auto Required, auto Excluded, size_t Bits>
+  requires std::is_same_v<std::remove_cv_t<decltype(Required)>, Mask<Bits>> &&
+           std::is_same_v<std::remove_cv_t<decltype(Excluded)>, Mask<Bits>>
+constexpr bool matches(Mask<Bits> const &mask) {
+  return [&]<size_t... W>(std::index_sequence<W...>) {
+    return (word_matches<Required, Excluded, W>(mask) && ...);
+  }(std::make_index_sequence<Mask<Bits>::word_count>{});
+}
+
+// Whether all bits of Query are set in mask.
+template <auto Query, size_t Bits>
+constexpr bool contains(Mask<Bits> const &mask) {
+  return matches<Query, Mask<Bits>{}>(mask);
+}
+
+template <Component... Cs> using Type = Mask<sizeof...(Cs) + 1>;
 
 template <Component... Cs> struct TypeFor {
   template <Component... Ts> constexpr static Type<Cs...> getType() {
-    constexpr auto valid_bit = 1u << sizeof...(Cs);
-    return {(bit_for<Ts, Cs...> | ... | valid_bit)};
+    constexpr auto valid_bit = sizeof...(Cs);
+
+    Type<Cs...> type;
+    (type.set(index_for<Ts, Cs...>), ...);
+    type.set(valid_bit);
+    return type;
   }
 };
 
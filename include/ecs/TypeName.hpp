@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string_view>
+
+namespace ECS::detail {
+// Readable name of T as the compiler spells it, e.g. for stats and for
+// matching event types across processes
+template <typename T> constexpr std::string_view type_name() {
+  std::string_view name = __PRETTY_FUNCTION__;
+  const auto start = name.find("T = ") + 4;
+  const auto end = name.find_first_of(";]", start);
+  return name.substr(start, end - start);
+}
+} // namespace ECS::detail
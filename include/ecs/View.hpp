@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Component.hpp"
+#include "EntityID.hpp"
+#include "SparseSet.hpp"
+
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <tuple>
+#include <vector>
+
+namespace ECS {
+
+// Random-access view over a fixed set of components. Lookups skip the
+// optional wrapping of Ecs::get_component, and gather() prefetches ahead so
+// long lists of cross-entity lookups don't stall on every indirection.
+//
+// A view stays valid across structural changes, but not across moving or
+// destroying the world it was created from.
+template <typename Type, Type Required, Component... Ts> class View {
+  // How many lookups ahead gather() prefetches the sparse and dense entries
+  constexpr static auto prefetch_distance = 8uz;
+
+public:
+  constexpr View(std::vector<Type> const &types, SparseSet<Ts> &...storages)
+      : types_{&types}, storages_{&storages...} {}
+
+  constexpr bool contains(EntityID id) const {
+    const auto i = id.value_;
+    return i < types_->size() && detail::contains<Required>((*types_)[i]);
+  }
+
+  // Unchecked access, `id` must have all components of the view.
+  template <Component T>
+    requires contains_v<T, Ts...>
+  constexpr T &get(EntityID id) const {
+    assert(contains(id));
+    return std::get<SparseSet<T> *>(storages_)->get(id.value_);
+  }
+
+  // Calls f with the components of every entity in ids that has all of them.
+  // Ids outside the world are skipped like entities missing a component.
+  template <std::invocable<Ts &...> F>
+  constexpr void gather(std::span<EntityID const> ids, F f) const {
+    const auto n = ids.size();
+
+    for (auto k = 0uz; k != n; ++k) {
+      if (k + 2 * prefetch_distance < n)
+        prefetch_slots(ids[k + 2 * prefetch_distance].value_);
+      if (k + prefetch_distance < n)
+        prefetch_data(ids[k + prefetch_distance].value_);
+
+      const auto i = ids[k].value_;
+      if (contains(ids[k]))
+        std::invoke(f, std::get<SparseSet<Ts> *>(storages_)->get(i)...);
+    }
+  }
+
+private:
+  constexpr void prefetch_slots(size_t i) const {
+    if (i >= types_->size())
+      return;
+    __builtin_prefetch(types_->data() + i);
+    (std::get<SparseSet<Ts> *>(storages_)->prefetch_slot(i), ...);
+  }
+
+  constexpr void prefetch_data(size_t i) const {
+    if (i >= types_->size())
+      return;
+    (std::get<SparseSet<Ts> *>(storages_)->prefetch_data(i), ...);
+  }
+
+  std::vector<Type> const *types_;
+  std::tuple<SparseSet<Ts> *...> storages_;
+};
+
+} // namespace ECS
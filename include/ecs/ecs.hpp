@@ -1,25 +1,108 @@
 #pragma once
 
+#include "Async.hpp"
+#include "ColdStore.hpp"
 #include "Component.hpp"
 #include "ComponentStorage.hpp"
 #include "EntityID.hpp"
 #include "Executor.hpp"
+#include "Observers.hpp"
+#include "PageJournal.hpp"
+#include "Query.hpp"
+#include "Stats.hpp"
 #include "System.hpp"
 #include "Type.hpp"
+#include "View.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <concepts>
+#include <filesystem>
+#include <mutex>
 #include <optional>
 #include <queue>
+#include <span>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 namespace ECS {
 
+template <Component... Cs> class SnapshotRing;
+
 template <Component... Cs> class Ecs {
+  friend class SnapshotRing<Cs...>;
+
   using TypeFor = detail::TypeFor<Cs...>;
   using Type = detail::Type<Cs...>;
 
   constexpr static auto valid_type_bit = sizeof...(Cs);
 
+  // Resources are listed among Cs but can't be attached to entities
+  template <typename C>
+  constexpr static bool is_component_v =
+      contains_v<C, Cs...> && !is_resource_v<C>;
+
+  using ColdStore = detail::ColdStore<Type, Cs...>;
+
+  // Evicted entities are stored bytewise
+  constexpr static bool evictable = (std::is_trivially_copyable_v<Cs> && ...);
+
+  // Per component, the number of components one partition of create_bulk
+  // adds, and then the next dense slot it constructs one in
+  using BulkSlots = std::array<size_t, sizeof...(Cs)>;
+
 public:
+  // Collects the components of one entity during create_bulk
+  class EntityBuilder {
+    friend class Ecs;
+
+  public:
+    // Adding a component the entity already has overwrites it, like
+    // add_components
+    template <Component... Ts>
+      requires(is_component_v<Ts> && ...)
+    void add(Ts &&...ts) {
+      (add_one(std::forward<Ts>(ts)), ...);
+    }
+
+    EntityID id() const { return EntityID{id_}; }
+
+  private:
+    EntityBuilder(Ecs &world, BulkSlots &slots, bool counting)
+        : world_{world}, slots_{slots}, counting_{counting} {}
+
+    template <typename T> void add_one(T &&t) {
+      using C = std::remove_cvref_t<T>;
+      constexpr auto index = index_for<C, Cs...>;
+
+      const auto repeated = type_.test(index);
+      type_.set(index);
+      if (counting_) {
+        slots_[index] += !repeated;
+        return;
+      }
+
+      auto &storage = world_.components_.template storage<C>();
+      if constexpr (std::default_initializable<C>) {
+        // A repeated add overwrites the slot of the first one
+        const auto slot = repeated ? slots_[index] - 1 : slots_[index]++;
+        storage.assign(slot, id_, std::forward<T>(t));
+      } else {
+        storage.add(id_, std::forward<T>(t));
+      }
+    }
+
+    Ecs &world_;
+    BulkSlots &slots_;
+    bool counting_;
+    size_t id_{};
+    Type type_{};
+  };
+
   template <Component... Ts>
-    requires(contains_v<Ts, Cs...> && ...)
+    requires(is_component_v<Ts> && ...)
   constexpr EntityID create(Ts &&...ts) noexcept {
     constexpr auto type = TypeFor::template getType<Ts...>();
 
@@ -28,100 +111,737 @@ public:
 
     (components_.insert(id, std::forward<Ts>(ts)), ...);
 
+    touch_type(id);
     if (id < types_.size())
       types_[id] = type;
     else
       types_.push_back(type);
 
+    update_queries(id, Type{});
+
+    (notify_added<std::remove_cvref_t<Ts>>(id), ...);
+
     return EntityID{id};
   }
 
+  // Creates n entities with fresh ids, calling init(i, builder) for the i-th
+  // one to add its components. The id range is split into partitions run on
+  // e. init runs twice per entity and has to add the same components both
+  // times: first to write the types and count the components of every
+  // partition, then to construct them right into the partition's slice of
+  // every storage. If a component isn't default initializable, the second
+  // pass runs serially.
+  template <std::invocable<size_t, EntityBuilder &> F,
+            Executor E = SerialExecutor>
+  void create_bulk(size_t n, F init, E e = {}) {
+    if (n == 0)
+      return;
+
+    const auto base = types_.size();
+    const auto n_partitions =
+        std::min(n, 4uz * std::max(1u, std::thread::hardware_concurrency()));
+
+    types_.resize(base + n);
+    (components_.template update_length<Cs>(base + n), ...);
+    touch_types(base, n);
+
+    std::vector<BulkSlots> slots(n_partitions);
+    const auto build = [&](size_t p, bool counting) {
+      EntityBuilder builder{*this, slots[p], counting};
+      for (auto i = p * n / n_partitions; i != (p + 1) * n / n_partitions;
+           ++i) {
+        builder.id_ = base + i;
+        builder.type_ = TypeFor::template getType<>();
+        init(i, builder);
+        if (counting)
+          types_[base + i] = builder.type_;
+        assert(types_[base + i] == builder.type_);
+      }
+    };
+
+    e.run(n_partitions, [&](size_t p) { build(p, true); });
+
+    // Partitions get consecutive slices, in id order
+    for_each_component([&]<Component C>() {
+      if constexpr (std::default_initializable<C>) {
+        constexpr auto index = index_for<C, Cs...>;
+        auto total = 0uz;
+        for (auto &partition : slots) {
+          const auto count = partition[index];
+          partition[index] = total;
+          total += count;
+        }
+
+        const auto first = components_.template storage<C>().grow(total);
+        for (auto &partition : slots)
+          partition[index] += first;
+      }
+    });
+
+    if constexpr ((std::default_initializable<Cs> && ...))
+      e.run(n_partitions, [&](size_t p) { build(p, false); });
+    else
+      for (auto p = 0uz; p != n_partitions; ++p)
+        build(p, false);
+
+    if (!queries_.empty())
+      for (auto i = base; i != types_.size(); ++i)
+        update_queries(i, Type{});
+
+    for_each_component(
+        [&]<Component C>() { notify_added_range<C>(base, types_.size()); });
+  }
+
   template <Component... Ts>
-    requires(contains_v<Ts, Cs...> && ...)
+    requires(is_component_v<Ts> && ...)
   constexpr void add_components(EntityID id, Ts &&...ts) noexcept {
     constexpr auto type = TypeFor::template getType<Ts...>();
 
+    fault_in(id.value_);
     assert(is_valid(id));
     const auto i = id.value_;
 
     (components_.insert(i, std::forward<Ts>(ts)), ...);
+
+    const auto old_type = types_[i];
+    touch_type(i);
     types_[i] |= type;
+    update_queries(i, old_type);
+
+    (notify_added_if_new<std::remove_cvref_t<Ts>>(i, old_type), ...);
   }
 
   template <Component... Ts>
-    requires(contains_v<Ts, Cs...> && ...)
+    requires(is_component_v<Ts> && ...)
   constexpr void remove_components(EntityID id) noexcept {
     constexpr auto type = TypeFor::template getType<Ts...>();
 
+    fault_in(id.value_);
     assert(is_valid(id));
     const auto i = id.value_;
 
+    (notify_removed<Ts>(i), ...);
     (components_.template remove<Ts>(i), ...);
+
+    const auto old_type = types_[i];
+    touch_type(i);
     types_[i] &= ~type;
     types_[i].set(valid_type_bit);
+    update_queries(i, old_type);
   }
 
   template <Component C>
-    requires(contains_v<C, Cs...>)
+    requires(is_component_v<C>)
   constexpr std::optional<std::reference_wrapper<C>>
   get_component(EntityID id) {
     constexpr auto type = TypeFor ::template getType<C>();
 
+    fault_in(id.value_);
     assert(is_valid(id));
     const auto i = id.value_;
 
-    if ((types_[i] & type) != type)
+    if (!detail::contains<type>(types_[i]))
       return std::nullopt;
 
     return components_.template get<C>(i);
   }
 
+  // Calls f(id, component) whenever C is added to an entity, by create,
+  // create_bulk or add_components. Overwriting an existing component doesn't
+  // count as adding it. f must not add or remove components of type C.
+  template <Component C, std::invocable<EntityID, C &> F>
+    requires(is_component_v<C>)
+  void on_add(F &&f) {
+    std::get<detail::Observers<C>>(observers_).added.emplace_back(
+        std::forward<F>(f));
+  }
+
+  // Calls f(id, component) right before C is removed from an entity, by
+  // remove_components or remove. f must not add or remove components of
+  // type C.
+  template <Component C, std::invocable<EntityID, C &> F>
+    requires(is_component_v<C>)
+  void on_remove(F &&f) {
+    std::get<detail::Observers<C>>(observers_).removed.emplace_back(
+        std::forward<F>(f));
+  }
+
+  template <Component R>
+    requires(contains_v<Resource<R>, Cs...>)
+  constexpr void set_resource(R r) {
+    components_.template resource<R>() = std::move(r);
+  }
+
+  template <Component R>
+    requires(contains_v<Resource<R>, Cs...>)
+  constexpr bool has_resource() {
+    return components_.template resource<R>().has_value();
+  }
+
+  template <Component R>
+    requires(contains_v<Resource<R>, Cs...>)
+  constexpr R &resource() {
+    assert(has_resource<R>());
+    return *components_.template resource<R>();
+  }
+
+  template <Component R>
+    requires(contains_v<Resource<R>, Cs...>)
+  constexpr void remove_resource() {
+    components_.template resource<R>().reset();
+  }
+
+  // Cached lookup path for systems that fetch components of other entities
+  // in a loop, see View.
+  template <Component... Ts>
+    requires(is_component_v<Ts> && ...)
+  constexpr auto view() {
+    constexpr auto type = TypeFor::template getType<Ts...>();
+    return View<Type, type, Ts...>{types_,
+                                   components_.template storage<Ts>()...};
+  }
+
   constexpr void remove(EntityID id) noexcept {
+    fault_in(id.value_);
     assert(is_valid(id));
 
     const auto i = id.value_;
+    for_each_component([&]<Component C>() { notify_removed<C>(i); });
     (components_.template remove<Cs>(i), ...);
 
-    types_[i] = 0u;
+    const auto old_type = types_[i];
+    touch_type(i);
+    types_[i] = {};
+    update_queries(i, old_type);
 
     free_ids_.push(i);
   }
 
+  // Ts are query terms, see Query.hpp
   template <typename Derived, Component... Ts, Executor E = SerialExecutor>
-    requires(contains_v<Ts, Cs...> && ...)
+    requires detail::Query<Ts...>::template valid_for<Cs...>
   constexpr void run(BaseSystem<Derived, Ts...> const &s, E e = {}) {
+    static_assert(!detail::starts_task<Derived,
+                                       typename detail::Query<Ts...>::Args> ||
+                      std::is_same_v<E, SerialExecutor>,
+                  "Async systems must use the SerialExecutor, the Scheduler "
+                  "isn't thread-safe");
+    static_assert(!SerialSystem<Derived> || std::is_same_v<E, SerialExecutor>,
+                  "Serial systems must use the SerialExecutor");
     run_impl<Ts...>(s, e);
   }
 
   template <Component... Ts, Executor E = SerialExecutor>
-    requires(contains_v<Ts, Cs...> && ...)
+    requires(is_component_v<Ts> && ...)
   constexpr void run(void (*fn)(Ts &...), E e = {}) {
     run_impl<Ts...>([=](Ts &...ts) { fn(ts...); }, e);
   }
 
+  // Runs all fused systems in one pass over the world, see fuse()
+  template <typename... Ss, Executor E = SerialExecutor>
+    requires(detail::QueryOf<Ss>::template valid_for<Cs...> && ...) &&
+            (!detail::QueryOf<Ss>::resources_only && ...)
+  constexpr void run(Fused<Ss...> const &fused, E e = {}) {
+    static_assert(
+        (detail::invocable_with<Ss, typename detail::QueryOf<Ss>::Args> &&
+         ...),
+        "Fused systems must define run for the arguments of their query, "
+        "run_block systems can't be fused");
+    static_assert(
+        (!detail::starts_task<Ss, typename detail::QueryOf<Ss>::Args> && ...) ||
+            std::is_same_v<E, SerialExecutor>,
+        "Async systems must use the SerialExecutor, the Scheduler isn't "
+        "thread-safe");
+    static_assert((!SerialSystem<Ss> && ...) ||
+                      std::is_same_v<E, SerialExecutor>,
+                  "Serial systems must use the SerialExecutor");
+
+    const std::array available{
+        detail::QueryOf<Ss>::available(components_)...};
+
+    with_journal([&]<bool Journal>() {
+      detail::run_range(e, types_.size(), [&](size_t begin, size_t end) {
+        std::apply(
+            [&](Ss const &...systems) {
+              for (auto i = begin; i != end; ++i) {
+                auto k = 0uz;
+                ((available[k++]
+                      ? visit<detail::QueryOf<Ss>, Journal>(systems, i)
+                      : void()),
+                 ...);
+              }
+            },
+            fused.systems);
+      });
+    });
+  }
+
+  // Folds every entity matching the query of s into one result. Every block
+  // of entities e hands out is reduced into a local accumulator on its own
+  // cache line, and the partial results are combined once at the end, in
+  // entity order so the result doesn't depend on scheduling.
+  template <typename Derived, typename Acc, Component... Ts,
+            Executor E = SerialExecutor>
+    requires detail::Query<Ts...>::template valid_for<Cs...>
+  Acc reduce(ReduceSystem<Derived, Acc, Ts...> const &s, E e = {}) {
+    using Query = detail::Query<Ts...>;
+
+    auto result = s.identity_value();
+    if (!Query::available(components_))
+      return result;
+
+    if constexpr (Query::resources_only) {
+      std::apply([&](auto &&...args) { s(result, args...); },
+                 Query::fetch(components_, Type{}, 0));
+      return result;
+    }
+
+    std::mutex mutex;
+    std::vector<std::pair<size_t, detail::CacheAligned<Acc>>> partials;
+    with_journal([&]<bool Journal>() {
+      detail::run_range(e, types_.size(), [&](size_t begin, size_t end) {
+        detail::CacheAligned<Acc> local{s.identity_value()};
+        for (auto i = begin; i != end; ++i)
+          if (Query::template matches<Cs...>(types_[i]))
+            std::apply([&](auto &&...args) { s(local.value, args...); },
+                       Query::template fetch<Journal>(components_, types_[i],
+                                                      i));
+
+        std::scoped_lock lock{mutex};
+        partials.emplace_back(begin, std::move(local));
+      });
+    });
+
+    std::ranges::sort(partials, {}, &decltype(partials)::value_type::first);
+    for (auto const &[begin, partial] : partials)
+      s.combine_into(result, partial.value);
+    return result;
+  }
+
+  // Resumes the async systems that are ready, see Scheduler. Runs in frame
+  // order like any other system.
+  void run(Scheduler &scheduler) { scheduler.poll(); }
+
+  // Registers a query whose matching entities are tracked incrementally from
+  // then on. Worth it for systems that run often over a small subset of the
+  // world, as every structural change pays for keeping the list current.
+  template <Component... Ts>
+    requires detail::Query<Ts...>::template valid_for<Cs...>
+  CachedQuery<Ts...> register_query() {
+    using Query = detail::Query<Ts...>;
+
+    auto &list = queries_.emplace_back(Query::template required<Cs...>,
+                                       Query::template excluded<Cs...>);
+    for (auto i = 0uz; i != types_.size(); ++i)
+      list.update(i, Type{}, types_[i]);
+
+    return CachedQuery<Ts...>{this, queries_.size() - 1};
+  }
+
+  template <typename Derived, Component... Ts, Executor E = SerialExecutor>
+  constexpr void run(CachedQuery<Ts...> query,
+                     BaseSystem<Derived, Ts...> const &s, E e = {}) {
+    using Query = detail::Query<Ts...>;
+    static_assert(!detail::starts_task<Derived, typename Query::Args> ||
+                      std::is_same_v<E, SerialExecutor>,
+                  "Async systems must use the SerialExecutor, the Scheduler "
+                  "isn't thread-safe");
+    static_assert(!SerialSystem<Derived> || std::is_same_v<E, SerialExecutor>,
+                  "Serial systems must use the SerialExecutor");
+    assert(query.world_ == this);
+    if (!Query::available(components_))
+      return;
+
+    auto const &entities = queries_[query.index_].entities();
+    if constexpr (BlockSystem<Derived, Ts...>) {
+      run_blocks<Query, false>(s, e, entities.size(),
+                               [&](size_t k) { return entities[k]; });
+    } else {
+      with_journal([&]<bool Journal>() {
+        detail::run_range(e, entities.size(), [&](size_t begin, size_t end) {
+          for (auto k = begin; k != end; ++k) {
+            const auto i = entities[k];
+            std::apply(s, Query::template fetch<Journal>(components_,
+                                                         types_[i], i));
+          }
+        });
+      });
+    }
+  }
+
+  // Restores sequential access to the storage of C, which swap-removal
+  // scrambles over time. Sorts by entity id, or in the storage order of By if
+  // given. Stops after roughly `budget` and returns whether the pass
+  // completed; call again (e.g. once per frame) to resume.
+  template <Component C, Component By = C>
+    requires(is_component_v<C> && is_component_v<By>)
+  bool defragment(std::chrono::nanoseconds budget) {
+    constexpr auto swaps_per_check = 1024uz;
+    const auto deadline = std::chrono::steady_clock::now() + budget;
+
+    auto &storage = components_.template storage<C>();
+    do {
+      bool done;
+      if constexpr (std::is_same_v<C, By>)
+        done = storage.sort_step(swaps_per_check);
+      else
+        done = storage.sort_step(components_.template storage<By>(),
+                                 swaps_per_check);
+      if (done)
+        return true;
+    } while (std::chrono::steady_clock::now() < deadline);
+
+    return false;
+  }
+
   void reserve(size_t n) { (components_.template update_length<Cs>(n), ...); }
 
-  constexpr bool is_valid(EntityID id) {
+  // NUMA-aware variant: storage for n entities is allocated untouched and
+  // initialized by the workers of e, so the block of entities each worker
+  // runs over lands on its node. Later runs should use the same executor (see
+  // ParallelExecutor::pinned) over a world of about n entities.
+  template <Executor E> void reserve(size_t n, E &e, NumaOptions options = {}) {
+    first_touch_types(n, e, options);
+    for_each_component([&]<Component C>() { first_touch<C>(n, e, options); });
+  }
+
+  // Tiered storage: evicted entities keep their ids but leave the world.
+  // Systems, queries and views skip them, and their types and components move
+  // to a file mapped from path, so resident memory follows the entities in
+  // use rather than the size of the world. They come back on load, or on
+  // access through get_component, add_components, remove_components or
+  // remove. Observers don't fire for either direction. SnapshotRing
+  // doesn't capture cold entities: rolling back past an eviction or a load
+  // fails and drops the snapshots.
+  void enable_cold_storage(std::filesystem::path const &path)
+    requires evictable
+  {
+    cold_.emplace(path);
+  }
+
+  // Evicts the entities of [first, first + count). Free and already evicted
+  // ids are skipped.
+  void evict(EntityID first, size_t count)
+    requires evictable
+  {
+    assert(cold_);
+    count = std::min(count, types_.size() - std::min(first.value_,
+                                                     types_.size()));
+    if (count == 0)
+      return;
+
+    const auto extent = cold_->open_extent(first.value_, count);
+    auto evicted = 0uz;
+    for (auto k = 0uz; k != count; ++k) {
+      const auto i = first.value_ + k;
+      const auto type = types_[i];
+      auto *record = cold_->record(extent, k);
+      ColdStore::set_type(record, type);
+      if (!type.test(valid_type_bit))
+        continue;
+
+      for_each_component([&]<Component C>() {
+        if (!type.test(index_for<C, Cs...>))
+          return;
+        ColdStore::set(record, components_.template get<C>(i));
+        components_.template remove<C>(i);
+      });
+
+      touch_type(i);
+      types_[i] = {};
+      update_queries(i, type);
+      ++evicted;
+    }
+
+    cold_->close_extent(extent, evicted);
+    if (evicted != 0)
+      ++cold_generation_;
+    for_each_component(
+        [&]<Component C>() { components_.template storage<C>().shrink(); });
+  }
+
+  // Brings the evicted entities of [first, first + count) back
+  void load(EntityID first, size_t count)
+    requires evictable
+  {
+    if (!cold_)
+      return;
+    const auto end = std::min(first.value_ + count, types_.size());
+    for (auto i = first.value_; i < end; ++i)
+      fault_in(i);
+  }
+
+  constexpr bool is_resident(EntityID id) {
     const auto i = id.value_;
     if (i >= types_.size())
       return false;
     return types_[i].test(valid_type_bit);
   }
 
+  constexpr bool is_valid(EntityID id) {
+    if (is_resident(id))
+      return true;
+    return cold_ && id.value_ < types_.size() && cold_->find(id.value_);
+  }
+
   constexpr size_t size() { return types_.size() - free_ids_.size(); }
 
+  // Snapshot of how much memory the world holds and how well it is used,
+  // see Stats.hpp. Serialize with to_json.
+  WorldStats memory_stats() {
+    WorldStats stats{
+        .storages = {},
+        .types_bytes = types_.capacity() * sizeof(Type),
+        .query_bytes = 0,
+        .free_id_bytes = free_ids_.size() * sizeof(size_t),
+        .journal_bytes = types_journal_.bytes(),
+        .observer_bytes = 0,
+        .entities = size(),
+        .free_ids = free_ids_.size(),
+        .fragmentation =
+            types_.empty() ? 0.
+                           : static_cast<double>(free_ids_.size()) /
+                                 static_cast<double>(types_.size()),
+        .cold_entities = cold_ ? cold_->size() : 0,
+        .cold_bytes = cold_ ? cold_->bytes() : 0,
+    };
+
+    for_each_component([&]<Component C>() {
+      stats.storages.push_back(storage_stats<C>());
+      stats.journal_bytes += components_.template storage<C>().journal_bytes();
+
+      auto const &observers = std::get<detail::Observers<C>>(observers_);
+      stats.observer_bytes +=
+          (observers.added.capacity() + observers.removed.capacity()) *
+          sizeof(typename detail::Observers<C>::Observer);
+    });
+
+    for (auto const &query : queries_)
+      stats.query_bytes += query.bytes();
+
+    return stats;
+  }
+
 private:
-  template <Component... Ts, System<Ts...> S, Executor E>
-    requires(contains_v<std::remove_cv_t<Ts>, Cs...> && ...)
+  template <Component... Ts, typename S, Executor E>
+    requires detail::Query<Ts...>::template valid_for<Cs...> &&
+             (QuerySystem<S, Ts...> || BlockSystem<S, Ts...>)
   constexpr void run_impl(const S &s, E e) {
-    constexpr auto type = TypeFor::template getType<std::remove_cv_t<Ts>...>();
+    using Query = detail::Query<Ts...>;
+    if (!Query::available(components_))
+      return;
+
+    if constexpr (BlockSystem<S, Ts...>) {
+      run_blocks<Query, true>(s, e, types_.size(), [](size_t i) { return i; });
+    } else if constexpr (Query::resources_only) {
+      std::apply(s, Query::fetch(components_, Type{}, 0));
+    } else {
+      with_journal([&]<bool Journal>() {
+        detail::run_range(e, types_.size(), [&](size_t begin, size_t end) {
+          for (auto i = begin; i != end; ++i)
+            visit<Query, Journal>(s, i);
+        });
+      });
+    }
+  }
+
+  // Hands the entities id_of(k) for k in [0, n) to the block form of s, in
+  // chunks of the executor's blocks small enough for the columns to stay in
+  // cache. With Filter, entities not matching Query are skipped. Callers
+  // check that the resources of Query are available.
+  template <typename Query, bool Filter, typename S, Executor E>
+  void run_blocks(S const &s, E &e, size_t n,
+                  std::invocable<size_t> auto id_of) {
+    constexpr auto chunk_size = 4096uz;
+
+    with_journal([&]<bool Journal>() {
+      detail::run_range(e, n, [&](size_t begin, size_t end) {
+        typename Query::BlockBuffers buffers;
+        for (auto first = begin; first < end; first += chunk_size) {
+          const auto last = std::min(first + chunk_size, end);
+
+          auto gathered = 0uz;
+          for (auto k = first; k != last; ++k) {
+            const auto i = id_of(k);
+            auto const &type = types_[i];
+            if (Filter && !Query::template matches<Cs...>(type))
+              continue;
+            Query::template gather<Journal>(buffers, components_, type, i);
+            ++gathered;
+          }
+          if (gathered == 0)
+            continue;
+
+          std::apply([&](auto &&...columns) { s.block(columns...); },
+                     Query::columns(buffers));
+          Query::scatter(buffers);
+        }
+      });
+    });
+  }
+
+  // Runs s on entity i if it matches Query. Callers check that the resources
+  // of Query are available.
+  template <typename Query, bool Journal, typename S>
+  constexpr void visit(S const &s, size_t i) {
+    auto const &type = types_[i];
+    if (Query::template matches<Cs...>(type))
+      std::apply(s, Query::template fetch<Journal>(components_, type, i));
+  }
+
+  // Calls f.template operator()<Journal>(), Journal being whether a
+  // SnapshotRing journals the writes to the world. Runs check it once instead
+  // of on every component they fetch.
+  template <typename F> constexpr void with_journal(F &&f) {
+    if (journaled_)
+      f.template operator()<true>();
+    else
+      f.template operator()<false>();
+  }
 
-    e.run(types_.size(), [&](size_t i) {
-      if ((types_[i] & type) == type)
-        s(components_.template get<std::remove_cv_t<Ts>>(i)...);
+  // The type array is scanned by every run, so it is placed like the storages
+  template <Executor E>
+  void first_touch_types(size_t n, E &e, NumaOptions const &options) {
+    const auto old_size = types_.size();
+    if (n <= old_size)
+      return;
+    types_.reserve(n);
+
+    auto *const types = reinterpret_cast<std::byte *>(types_.data());
+    if (options.huge_pages)
+      detail::advise_huge_pages(types + old_size * sizeof(Type),
+                                (n - old_size) * sizeof(Type));
+
+    detail::run_range(e, n, [&](size_t begin, size_t end) {
+      begin = std::max(begin, old_size);
+      if (begin < end)
+        detail::populate(types + begin * sizeof(Type),
+                         (end - begin) * sizeof(Type));
     });
   }
 
+  template <Component C, Executor E>
+  void first_touch(size_t n, E &e, NumaOptions const &options) {
+    auto &storage = components_.template storage<C>();
+    const auto old_length = storage.id_capacity();
+
+    storage.reserve_untouched(n, options.dense_capacity);
+
+    const auto sparse = storage.sparse_memory();
+    const auto dense = storage.spare_dense_memory();
+    if (options.huge_pages) {
+      detail::advise_huge_pages(sparse.data(), sparse.size());
+      detail::advise_huge_pages(dense.data(), dense.size());
+    }
+
+    // Partitioned like run_impl, so each worker touches the cells and the
+    // share of dense storage that its block of ids will use
+    const auto entries = dense.size() / SparseSet<C>::entry_size;
+    detail::run_range(e, n, [&](size_t begin, size_t end) {
+      for (auto i = std::max(begin, old_length); i < end; ++i)
+        storage.clear_slot(i);
+
+      const auto first = begin * entries / n * SparseSet<C>::entry_size;
+      const auto last = end * entries / n * SparseSet<C>::entry_size;
+      detail::populate(dense.data() + first, last - first);
+    });
+  }
+
+  // Calls f.template operator()<C>() for every C that isn't a resource
+  template <typename F> constexpr void for_each_component(F &&f) {
+    (
+        [&] {
+          if constexpr (!is_resource_v<Cs>)
+            f.template operator()<Cs>();
+        }(),
+        ...);
+  }
+
+  template <Component C> StorageStats storage_stats() {
+    auto const &storage = components_.template storage<C>();
+    return {
+        .component = detail::type_name<C>(),
+        .sparse_bytes = storage.sparse_bytes(),
+        .dense_bytes = storage.dense_bytes(),
+        .size = storage.size(),
+        .capacity = storage.capacity(),
+        .sparse_size = storage.id_capacity(),
+        .holes = storage.id_capacity() - storage.size(),
+    };
+  }
+
+  template <Component C> void notify_added(size_t i) {
+    auto &observers = std::get<detail::Observers<C>>(observers_).added;
+    if (observers.empty())
+      return;
+
+    auto &c = components_.template get<C>(i);
+    for (auto &observer : observers)
+      observer(EntityID{i}, c);
+  }
+
+  template <Component C>
+  void notify_added_if_new(size_t i, Type const &old_type) {
+    if (!old_type.test(index_for<C, Cs...>))
+      notify_added<C>(i);
+  }
+
+  template <Component C> void notify_added_range(size_t begin, size_t end) {
+    if (std::get<detail::Observers<C>>(observers_).added.empty())
+      return;
+
+    for (auto i = begin; i != end; ++i)
+      if (types_[i].test(index_for<C, Cs...>))
+        notify_added<C>(i);
+  }
+
+  template <Component C> void notify_removed(size_t i) {
+    auto &observers = std::get<detail::Observers<C>>(observers_).removed;
+    if (observers.empty() || !types_[i].test(index_for<C, Cs...>))
+      return;
+
+    auto &c = components_.template get<C>(i);
+    for (auto &observer : observers)
+      observer(EntityID{i}, c);
+  }
+
+  // Loads entity i back if it is evicted
+  void fault_in(size_t i) {
+    if constexpr (evictable) {
+      if (!cold_ || i >= types_.size() || types_[i].test(valid_type_bit))
+        return;
+
+      auto *record = cold_->find(i);
+      if (!record)
+        return;
+
+      const auto type = ColdStore::type(record);
+      for_each_component([&]<Component C>() {
+        if (type.test(index_for<C, Cs...>))
+          components_.insert(i, ColdStore::template get<C>(record));
+      });
+
+      touch_type(i);
+      types_[i] = type;
+      update_queries(i, Type{});
+      cold_->loaded(i, record);
+      ++cold_generation_;
+    }
+  }
+
+  // Call before writing types_[i], or the n types from first
+  void touch_type(size_t i) { touch_types(i, 1); }
+
+  void touch_types(size_t first, size_t n) {
+    types_journal_.touch(std::as_bytes(std::span{types_}),
+                         first * sizeof(Type), n * sizeof(Type));
+  }
+
+  constexpr void update_queries(size_t i, Type const &old_type) {
+    for (auto &query : queries_)
+      query.update(i, old_type, types_[i]);
+  }
+
   constexpr size_t next_id() noexcept {
     if (free_ids_.empty())
       return types_.size();
@@ -133,6 +853,16 @@ private:
   ComponentStorage<Cs...> components_;
   std::vector<Type> types_;
   std::queue<size_t> free_ids_;
+  std::vector<detail::MatchList<Type>> queries_;
+  std::tuple<detail::Observers<Cs>...> observers_;
+  std::optional<ColdStore> cold_;
+
+  // Pages of types_ written since the last snapshot, see SnapshotRing. The
+  // storages journal their own pages while journaled_ is set.
+  detail::PageJournal types_journal_;
+  bool journaled_{};
+  // Counts evictions and loads, which snapshots don't survive
+  size_t cold_generation_{};
 };
 
 } // namespace ECS
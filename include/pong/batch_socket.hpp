@@ -0,0 +1,84 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <chrono>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// Nonblocking UDP socket that moves many datagrams per syscall. Waiting is
+// done with epoll, receiving and sending with recvmmsg/sendmmsg into buffers
+// allocated once up front.
+class BatchSocket {
+public:
+  struct Packet {
+    // Points into the socket's receive buffers, valid until the next receive
+    std::span<std::byte const> data;
+    sockaddr_in from;
+  };
+
+  // Binds to the given port on all interfaces, 0 picks a free one
+  explicit BatchSocket(in_port_t port = 0, size_t batch_size = 64,
+                       size_t packet_size = 1500);
+  ~BatchSocket();
+
+  BatchSocket(BatchSocket const &) = delete;
+  BatchSocket &operator=(BatchSocket const &) = delete;
+
+  // Local port in host byte order
+  in_port_t port() const;
+
+  // For waiting on the socket with another poller, e.g. ECS::Scheduler
+  int fd() const { return socket_; }
+
+  // Blocks until datagrams can be received or the timeout expires. Returns
+  // whether there is something to receive.
+  bool wait(std::chrono::milliseconds timeout);
+
+  // Receives up to batch_size datagrams with a single syscall, without
+  // blocking. Returns an empty span if nothing is pending. Datagrams longer
+  // than packet_size are dropped, see truncated().
+  std::span<Packet const> receive();
+
+  // Datagrams dropped by receive for not fitting into a packet buffer
+  size_t truncated() const { return truncated_; }
+
+  // Queues a datagram for the next flush, flushing first if the batch is
+  // full. Datagrams longer than packet_size are dropped, see oversized().
+  void queue(std::span<std::byte const> data, sockaddr_in const &to);
+
+  template <typename T> void queue(T const &t, sockaddr_in const &to) {
+    queue(std::as_bytes(std::span{&t, 1}), to);
+  }
+
+  // Datagrams dropped by queue for not fitting into a packet buffer
+  size_t oversized() const { return oversized_; }
+
+  // Sends all queued datagrams, returns how many were sent
+  size_t flush();
+
+  // Address of this host's loopback interface at the given port
+  static sockaddr_in loopback(in_port_t port);
+
+private:
+  int socket_;
+  int epoll_;
+  size_t packet_size_;
+
+  std::vector<std::byte> receive_buffer_;
+  std::vector<iovec> receive_iov_;
+  std::vector<sockaddr_in> receive_addresses_;
+  std::vector<mmsghdr> receive_messages_;
+  std::vector<Packet> packets_;
+  size_t truncated_{};
+
+  std::vector<std::byte> send_buffer_;
+  std::vector<iovec> send_iov_;
+  std::vector<sockaddr_in> send_addresses_;
+  std::vector<mmsghdr> send_messages_;
+  size_t queued_{};
+  size_t oversized_{};
+};
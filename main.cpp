@@ -1,7 +1,7 @@
 #include <chrono>
+#include <cstdint>
 #include <fmt/core.h>
 #include <fmt/format.h>
-#include <random>
 #include <string_view>
 #include <thread>
 
@@ -38,6 +38,15 @@ struct GravitySystem : public ECS::BaseSystem<GravitySystem, Physics, Gravity> {
   void run(Physics &p, Gravity const &) const { p.acceleration.y -= 9.81; }
 };
 
+struct PhysicsSystem
+    : public ECS::BaseSystem<PhysicsSystem, Position, Physics> {
+  void run(Position &pos, Physics &phy) const {
+    phy.velocity += phy.acceleration;
+    pos.position += phy.velocity;
+    phy.acceleration = Vec2{};
+  }
+};
+
 struct Printer : public ECS::BaseSystem<Printer, Index, Position> {
   void run(Index const &i, Position const &p) const {
     const auto [x, y] = p.position;
@@ -45,6 +54,15 @@ struct Printer : public ECS::BaseSystem<Printer, Index, Position> {
   }
 };
 
+// Stateless hash of a counter, so entities can draw random numbers in any
+// order and on any thread and still get the same world
+constexpr std::uint64_t splitmix64(std::uint64_t x) {
+  x += 0x9e3779b97f4a7c15;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+  return x ^ (x >> 31);
+}
+
 void perf_test(size_t N = 250'000'000uz) {
   using ECS = ECS::Ecs<Index, Position, Physics, Gravity>;
 
@@ -62,48 +80,54 @@ void perf_test(size_t N = 250'000'000uz) {
     return elapsed;
   };
 
-  ecs.reserve(N);
+  // Storage is placed on the NUMA node of the worker that runs over it
+  auto executor = ::ECS::ParallelExecutor::pinned();
+  ecs.reserve(N, executor, {.huge_pages = true});
 
-  std::mt19937 rng{};
-  std::bernoulli_distribution dist{0.25};
+  time(
+      [&] {
+        ecs.create_bulk(
+            N,
+            [](size_t i, auto &entity) {
+              // Two independent draws with p = 0.25 each
+              const auto r = splitmix64(i);
 
-  for (auto i = 0uz; i != N; ++i) {
-    const auto id = ecs.create(Index{i});
+              entity.add(Index{i});
 
-    if (dist(rng)) {
-      ecs.add_components(id, Position{});
-    }
+              if ((r & 3) == 0) {
+                entity.add(Position{});
+              }
 
-    if (dist(rng)) {
-      ecs.add_components(id, Physics{}, Gravity{});
-    }
-  }
+              if (((r >> 2) & 3) == 0) {
+                entity.add(Physics{}, Gravity{});
+              }
+            },
+            executor);
+      },
+      "World setup");
 
   while (true) {
 
-    time([&] { ecs.run(GravitySystem{}); }, "Gravity update");
+    time([&] { ecs.run(GravitySystem{}, executor); }, "Gravity update");
+
+    time([&] { ecs.run(PhysicsSystem{}, executor); }, "Physics update");
 
     time(
         [&] {
-          ecs.run(+[](Position &pos, Physics &phy) {
-            phy.velocity += phy.acceleration;
-            pos.position += phy.velocity;
-            phy.acceleration = Vec2{};
-          });
+          ecs.run(::ECS::fuse(GravitySystem{}, PhysicsSystem{}), executor);
         },
-        "Physics update");
+        "Fused update");
 
     using std::chrono_literals::operator""ms;
     std::this_thread::sleep_for(500ms);
   }
 }
 
-struct Counter : ECS::BaseSystem<Counter> {
-  static size_t counter;
+struct Counter : ECS::ReduceSystem<Counter, size_t> {
+  void run(size_t &count) const noexcept { count++; }
 
-  void run() const noexcept { counter++; }
+  void combine(size_t &count, size_t other) const noexcept { count += other; }
 };
-size_t Counter::counter = 0;
 
 void remove_test() {
   using Ecs = ECS::Ecs<Index, Position>;
@@ -136,8 +160,8 @@ void remove_test() {
 
   ecs.run(+[](Index const &i) { fmt::println("Entity {}", i.i); });
 
-  ecs.run(Counter{});
-  fmt::println("{} entities - {} entities", Counter::counter, ecs.size());
+  const auto counted = ecs.reduce(Counter{}, ECS::ParallelExecutor{});
+  fmt::println("{} entities - {} entities", counted, ecs.size());
 }
 
 int main() {}
@@ -1,8 +1,16 @@
+#include "ecs/SpatialGrid.hpp"
 #include "ecs/ecs.hpp"
 
-#include "pong/socket.hpp"
+#include "pong/batch_socket.hpp"
 #include "raylib.h"
+#include <arpa/inet.h>
+#include <array>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <span>
+#include <string>
+#include <vector>
 
 struct Ball;
 struct Player;
@@ -13,7 +21,8 @@ struct Server;
 struct Client;
 
 using Ecs =
-    ECS::Ecs<Ball, Player, Physics, Score, PlayerController, Server, Client>;
+    ECS::Ecs<Ball, Player, Physics, PlayerController, ECS::Resource<Score>,
+             ECS::Resource<Server>, ECS::Resource<Client>>;
 
 #define IGNORE (void)
 
@@ -61,7 +70,8 @@ struct PlayerRenderer : ECS::BaseSystem<PlayerRenderer, Player> {
   }
 };
 
-struct ScoreRenderer : ECS::BaseSystem<ScoreRenderer, Score> {
+struct ScoreRenderer
+    : ECS::BaseSystem<ScoreRenderer, ECS::Resource<Score const>> {
   void run(Score const &s) const {
     {
       const auto t = std::format("{}", s.left);
@@ -76,6 +86,14 @@ struct ScoreRenderer : ECS::BaseSystem<ScoreRenderer, Score> {
   int width;
 };
 
+using PlayerView = decltype(std::declval<Ecs &>().view<Player>());
+
+ECS::Aabb paddle_box(Player const &player) {
+  const auto [x, y] = player.position;
+  const auto [w, h] = Player::size;
+  return {x, y, x + w, y + h};
+}
+
 struct BallUpdate : ECS::BaseSystem<BallUpdate, Ball, Physics> {
   void run(Ball &ball, Physics &p) const {
     auto &[x, y] = ball.position;
@@ -84,10 +102,16 @@ struct BallUpdate : ECS::BaseSystem<BallUpdate, Ball, Physics> {
     if (y >= height - ball.radius || y <= ball.radius)
       vy *= -1;
 
-    if (collides(ball, left))
-      vx = 1;
-    if (collides(ball, right))
-      vx = -1;
+    // The grid narrows the paddles down to those near the ball. Bounce away
+    // from the side of the paddle that was hit.
+    std::vector<ECS::EntityID> near;
+    paddles.query(ECS::Aabb{x - ball.radius, y - ball.radius, x + ball.radius,
+                            y + ball.radius},
+                  [&](ECS::EntityID id) { near.push_back(id); });
+    players.gather(near, [&](Player const &player) {
+      if (collides(ball, player))
+        vx = player.position.x < width / 2 ? 1 : -1;
+    });
 
     x += vx * p.speed;
     y += vy * p.speed;
@@ -95,16 +119,17 @@ struct BallUpdate : ECS::BaseSystem<BallUpdate, Ball, Physics> {
     p.speed *= 1 + 5e-4f;
   }
 
-  bool collides(Ball const &ball, ECS::EntityID player) const {
-    const auto [x, y] = ecs.get_component<Player>(player)->get().position;
+  static bool collides(Ball const &ball, Player const &player) {
+    const auto [x, y] = player.position;
     const auto [w, h] = Player::size;
     return CheckCollisionCircleRec(ball.position, ball.radius,
                                    Rectangle{x, y, w, h});
   }
 
   float width, height;
-  Ecs &ecs;
-  ECS::EntityID left, right;
+  // Built once per tick rather than per lookup
+  PlayerView players;
+  ECS::SpatialGrid &paddles;
 };
 
 struct PlayerUpdate : ECS::BaseSystem<PlayerUpdate, Player, PlayerController> {
@@ -121,7 +146,8 @@ struct PlayerUpdate : ECS::BaseSystem<PlayerUpdate, Player, PlayerController> {
   float height;
 };
 
-struct ScoreUpdate : ECS::BaseSystem<ScoreUpdate, Score, Ball> {
+struct ScoreUpdate
+    : ECS::BaseSystem<ScoreUpdate, ECS::Resource<Score>, Ball> {
   void run(Score &s, Ball &ball) const {
     auto &[x, _] = ball.position;
 
@@ -153,67 +179,128 @@ struct [[gnu::packed]] ClientPacket {
   Player player;
 };
 
-struct ServerUpdate : ECS::BaseSystem<ServerUpdate, Server> {
+// Reads a received datagram in place as a packet of type T, or returns
+// nullptr if it has the wrong size
+template <typename T> T const *as_packet(std::span<std::byte const> data) {
+  static_assert(alignof(T) == 1, "Packets are read from unaligned buffers");
+  if (data.size() != sizeof(T))
+    return nullptr;
+  return reinterpret_cast<T const *>(data.data());
+}
+
+struct ServerUpdate
+    : ECS::BaseSystem<ServerUpdate, ECS::Resource<Server const>> {
   void run(Server const &s) const {
     auto ball = ecs.get_component<Ball>(s.ball).value().get();
     ball.position.x = width - ball.position.x;
     auto player = ecs.get_component<Player>(s.left).value().get();
     player.position.x = width - player.position.x;
 
-    socket.send(ServerPacket{ball, player});
-    auto const response = socket.receive<ClientPacket>();
+    socket.queue(ServerPacket{ball, player}, peer);
+    socket.flush();
+  }
 
-    if (!response.has_value())
-      return;
+  BatchSocket &socket;
+  sockaddr_in const &peer;
+  Ecs &ecs;
+  float width;
+};
 
-    ecs.get_component<Player>(s.right).value().get() = response->player;
+// Applies the client's packets as they arrive. Resumed by the scheduler
+// between systems instead of polling the socket every frame.
+struct ServerReceive
+    : ECS::BaseSystem<ServerReceive, ECS::Resource<Server const>> {
+  ECS::Task run(Server s) const {
+    for (;;) {
+      co_await scheduler.readable(socket.fd());
+      for (auto packets = socket.receive(); !packets.empty();
+           packets = socket.receive())
+        for (auto const &packet : packets)
+          if (auto const *p = as_packet<ClientPacket>(packet.data))
+            ecs.get_component<Player>(s.right).value().get() = p->player;
+    }
   }
 
-  void wait_for_connection() { socket.wait_for_connection(); }
-
-  Socket socket{};
+  BatchSocket &socket;
   Ecs &ecs;
-  float width;
+  ECS::Scheduler &scheduler;
 };
 
-struct ClientUpdate : ECS::BaseSystem<ClientUpdate, Client> {
+struct ClientUpdate : ECS::BaseSystem<ClientUpdate, ECS::Resource<Client>> {
   void run(Client &c) const {
     auto player = ecs.get_component<Player>(c.left).value().get();
     player.position.x = width - player.position.x;
 
-    socket.send(ClientPacket{player});
+    socket.queue(ClientPacket{player}, peer);
+    socket.flush();
+  }
 
-    auto const response = socket.receive<ServerPacket>();
-    if (!response)
-      return;
+  BatchSocket &socket;
+  sockaddr_in const &peer;
+  Ecs &ecs;
+  float width;
+};
 
-    ecs.get_component<Ball>(c.ball).value().get() = response->ball;
-    ecs.get_component<Player>(c.right).value().get() = response->player;
+struct ClientReceive
+    : ECS::BaseSystem<ClientReceive, ECS::Resource<Client const>> {
+  ECS::Task run(Client c) const {
+    for (;;) {
+      co_await scheduler.readable(socket.fd());
+      for (auto packets = socket.receive(); !packets.empty();
+           packets = socket.receive())
+        for (auto const &packet : packets)
+          if (auto const *p = as_packet<ServerPacket>(packet.data)) {
+            ecs.get_component<Ball>(c.ball).value().get() = p->ball;
+            ecs.get_component<Player>(c.right).value().get() = p->player;
+          }
+    }
   }
 
-  void connect() {
-    std::string addr_string;
-    std::cout << "Server addresss: " << std::flush;
-    std::cin >> addr_string;
+  BatchSocket &socket;
+  Ecs &ecs;
+  ECS::Scheduler &scheduler;
+};
 
-    in_port_t port;
-    std::cout << "Server port: " << std::flush;
-    std::cin >> port;
+// The server learns the address of the client from its first datagram
+sockaddr_in wait_for_client(BatchSocket &socket) {
+  std::println(std::cout, "Listening on port {}...", socket.port());
 
-    socket.connect(addr_string, port);
+  for (;;) {
+    socket.wait(std::chrono::milliseconds{-1});
+    if (auto const packets = socket.receive(); !packets.empty())
+      return packets.front().from;
   }
+}
 
-  Socket socket{};
-  Ecs &ecs;
-  float width;
-};
+// "localhost" connects to a server on this machine
+sockaddr_in connect_to_server(BatchSocket &socket) {
+  std::string addr_string;
+  std::cout << "Server address: " << std::flush;
+  std::cin >> addr_string;
+
+  in_port_t port;
+  std::cout << "Server port: " << std::flush;
+  std::cin >> port;
+
+  auto server = BatchSocket::loopback(port);
+  if (addr_string != "localhost" &&
+      inet_aton(addr_string.c_str(), &server.sin_addr) == 0) {
+    std::println(std::cerr, "Invalid address '{}'", addr_string);
+    std::exit(1);
+  }
+
+  constexpr char hello[] = "PONG";
+  socket.queue(std::as_bytes(std::span{hello}), server);
+  socket.flush();
+  return server;
+}
 
 int main() {
   constexpr auto width = 800, height = 600;
 
   Ecs ecs{};
 
-  const auto ball = ecs.create(Ball{Vector2{width / 2., height / 2.}}, Score{});
+  const auto ball = ecs.create(Ball{Vector2{width / 2., height / 2.}});
   const auto left =
       ecs.create(Player{{.x = 10, .y = height / 2.}},
                  PlayerController{.up = KEY_UP, .down = KEY_DOWN});
@@ -222,6 +309,11 @@ int main() {
       .y = height / 2.,
   }});
 
+  ecs.set_resource(Score{});
+
+  ECS::SpatialGrid paddles{Player::size.y};
+  paddles.remove_on<Player>(ecs);
+
   std::println(std::cout, "Is this the server? y/N");
   char answer{};
   std::cin >> answer;
@@ -230,9 +322,9 @@ int main() {
 
   if (is_server) {
     ecs.add_components(ball, Physics{});
-    ecs.create(Server{left, right, ball});
+    ecs.set_resource(Server{left, right, ball});
   } else {
-    ecs.create(Client{left, right, ball});
+    ecs.set_resource(Client{left, right, ball});
   }
 
   InitWindow(width, height, "ECS Pong");
@@ -240,14 +332,22 @@ int main() {
 
   SetTraceLogLevel(LOG_DEBUG);
 
-  ServerUpdate server_update{.ecs = ecs, .width = width};
-  ClientUpdate client_update{.ecs = ecs, .width = width};
+  BatchSocket socket{};
+  const auto peer =
+      is_server ? wait_for_client(socket) : connect_to_server(socket);
 
-  if (is_server) {
-    server_update.wait_for_connection();
-  } else {
-    client_update.connect();
-  }
+  ServerUpdate server_update{
+      .socket = socket, .peer = peer, .ecs = ecs, .width = width};
+  ClientUpdate client_update{
+      .socket = socket, .peer = peer, .ecs = ecs, .width = width};
+
+  ECS::Scheduler scheduler;
+  ServerReceive server_receive{
+      .socket = socket, .ecs = ecs, .scheduler = scheduler};
+  ClientReceive client_receive{
+      .socket = socket, .ecs = ecs, .scheduler = scheduler};
+  ecs.run(server_receive);
+  ecs.run(client_receive);
 
   while (!WindowShouldClose()) {
     BeginDrawing();
@@ -261,13 +361,14 @@ int main() {
     EndDrawing();
 
     ecs.run(PlayerUpdate{.height = height});
+    ecs.run(ECS::GridSync<Player>{.grid = paddles, .box_of = paddle_box});
     ecs.run(BallUpdate{.width = width,
                        .height = height,
-                       .ecs = ecs,
-                       .left = left,
-                       .right = right});
+                       .players = ecs.view<Player>(),
+                       .paddles = paddles});
     ecs.run(server_update);
     ecs.run(client_update);
+    ecs.run(scheduler);
     ecs.run(ScoreUpdate{.ecs = ecs, .width = width});
   }
 
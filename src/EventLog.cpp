@@ -0,0 +1,182 @@
+#include "ecs/EventLog.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace ECS::Event {
+
+EventLog::EventLog(std::filesystem::path const &path) : file_{path} {
+  std::memcpy(append(details::log_magic.size()), details::log_magic.data(),
+              details::log_magic.size());
+  append_value(uint64_t{end_ + sizeof(uint64_t)});
+}
+
+EventLog::~EventLog() { file_.resize(end_); }
+
+void EventLog::record(Event const &e) noexcept {
+  const auto key = e.key();
+  const auto it = std::ranges::find(types_, key, &Type::key);
+  if (it == types_.end())
+    return;
+
+  const auto id = static_cast<uint16_t>(it - types_.begin());
+  if (!it->defined)
+    define(*it, id);
+
+  const auto size = it->size(e);
+  append_value(id);
+  if (it->fixed_size == 0)
+    append_value(static_cast<uint32_t>(size));
+  it->encode(e, append(size));
+
+  // Publish the record, so logs that were never closed can still be read
+  const uint64_t length = end_;
+  std::memcpy(file_.data() + details::log_magic.size(), &length,
+              sizeof(length));
+  ++events_;
+}
+
+void EventLog::add_type(Type type) {
+  // The last id marks definitions
+  if (types_.size() >= details::definition_id) {
+    std::fprintf(stderr, "EventLog: more than %u event types registered\n",
+                 unsigned{details::definition_id});
+    std::exit(1);
+  }
+  types_.push_back(type);
+}
+
+void EventLog::define(Type &type, uint16_t id) {
+  append_value(details::definition_id);
+  append_value(id);
+  append_value(type.fixed_size);
+  append_value(static_cast<uint16_t>(type.name.size()));
+  std::memcpy(append(type.name.size()), type.name.data(), type.name.size());
+  type.defined = true;
+}
+
+std::byte *EventLog::append(size_t n) {
+  constexpr auto initial_size = 1uz << 20;
+
+  if (end_ + n > file_.size())
+    file_.resize(std::max({end_ + n, 2 * file_.size(), initial_size}));
+
+  auto *const out = file_.data() + end_;
+  end_ += n;
+  return out;
+}
+
+EventReplay::EventReplay(std::filesystem::path const &path)
+    : file_{path, ECS::detail::MappedFile::Mode::read} {
+  if (file_.size() < details::log_header_size ||
+      std::memcmp(file_.data(), details::log_magic.data(),
+                  details::log_magic.size()) != 0) {
+    std::fprintf(stderr, "EventReplay: %s is not an event log\n",
+                 path.c_str());
+    std::exit(1);
+  }
+}
+
+namespace {
+// Reads values from the front of a span
+class Reader {
+public:
+  explicit Reader(std::span<std::byte const> bytes) : bytes_{bytes} {}
+
+  bool empty() const { return bytes_.empty(); }
+
+  template <typename T> T value() {
+    T t;
+    std::memcpy(&t, take(sizeof(T)).data(), sizeof(T));
+    return t;
+  }
+
+  std::span<std::byte const> take(size_t n) {
+    if (n > bytes_.size()) {
+      std::fputs("EventReplay: truncated log\n", stderr);
+      std::exit(1);
+    }
+    const auto result = bytes_.first(n);
+    bytes_ = bytes_.subspan(n);
+    return result;
+  }
+
+private:
+  std::span<std::byte const> bytes_;
+};
+
+struct Decoder {
+  uint32_t fixed_size;
+  // Null for types that aren't registered
+  void (*emit)(EventManager &, std::span<std::byte const>);
+  // Whether the log defined the id yet
+  bool defined;
+};
+} // namespace
+
+size_t EventReplay::replay(EventManager &manager, size_t batch) {
+  uint64_t length;
+  std::memcpy(&length, file_.data() + details::log_magic.size(),
+              sizeof(length));
+
+  Reader reader{std::span<std::byte const>{file_.data(), file_.size()}
+                    .first(std::min<size_t>(length, file_.size()))
+                    .subspan(details::log_header_size)};
+  std::vector<Decoder> decoders;
+  auto emitted = 0uz;
+
+  while (!reader.empty()) {
+    const auto id = reader.value<uint16_t>();
+
+    if (id == details::definition_id) {
+      const auto defined = reader.value<uint16_t>();
+      const auto fixed_size = reader.value<uint32_t>();
+      const auto length = reader.value<uint16_t>();
+      const auto name = reader.take(length);
+
+      const auto it =
+          std::ranges::find(types_,
+                            std::string_view{reinterpret_cast<char const *>(
+                                                 name.data()),
+                                             name.size()},
+                            &Type::name);
+
+      // The type changed layout since the log was recorded
+      const auto matches = it != types_.end() && it->fixed_size == fixed_size;
+      if (it != types_.end() && !matches)
+        std::fprintf(stderr,
+                     "EventReplay: skipping %.*s, logged with size %u but "
+                     "registered with size %u\n",
+                     int(it->name.size()), it->name.data(),
+                     unsigned{fixed_size}, unsigned{it->fixed_size});
+
+      if (defined >= decoders.size())
+        decoders.resize(defined + 1uz);
+      decoders[defined] = {fixed_size, matches ? it->emit : nullptr, true};
+      continue;
+    }
+
+    if (id >= decoders.size() || !decoders[id].defined) {
+      std::fprintf(stderr, "EventReplay: corrupt log, undefined type id %u\n",
+                   unsigned{id});
+      std::exit(1);
+    }
+    const auto &decoder = decoders[id];
+    const auto size = decoder.fixed_size != 0 ? decoder.fixed_size
+                                              : reader.value<uint32_t>();
+    const auto payload = reader.take(size);
+    if (!decoder.emit)
+      continue;
+
+    decoder.emit(manager, payload);
+    ++emitted;
+    if (batch != 0 && emitted % batch == 0)
+      manager.notify_clients();
+  }
+
+  manager.notify_clients();
+  return emitted;
+}
+
+} // namespace ECS::Event
@@ -1,5 +1,6 @@
 #include "ecs/EventManager.hpp"
 #include "ecs/EventClient.hpp"
+#include "ecs/EventLog.hpp"
 
 namespace ECS::Event {
 std::shared_ptr<EventClient> EventManager::make_client() noexcept {
@@ -11,7 +12,32 @@ std::shared_ptr<EventClient> EventManager::make_client() noexcept {
   return ptr;
 }
 
-void EventManager::_emit(Event e) noexcept { events_.emplace(std::move(e)); }
+void EventManager::_emit(Event e) noexcept {
+  if (log_)
+    log_->record(e);
+  events_.emplace(std::move(e));
+}
+
+void EventManager::tick(uint64_t n) noexcept {
+  timers_.advance(n, due_);
+  for (auto &e : due_) {
+    const auto it = coalescers_by_key_.find(e.key());
+    if (it == coalescers_by_key_.end()) {
+      _emit(std::move(e));
+      continue;
+    }
+    if (it->second->add(std::move(e)))
+      dirty_.push_back(it->second);
+  }
+  due_.clear();
+}
+
+void EventManager::advance(std::chrono::nanoseconds elapsed) noexcept {
+  elapsed_ += elapsed;
+  const auto ticks = elapsed_ / tick_length_;
+  elapsed_ -= ticks * tick_length_;
+  tick(static_cast<uint64_t>(ticks));
+}
 
 static void
 remove_dead_clients(std::vector<std::weak_ptr<EventClient>> &clients) {
@@ -25,8 +51,19 @@ remove_dead_clients(std::vector<std::weak_ptr<EventClient>> &clients) {
   }
 }
 
+void EventManager::flush_coalesced() noexcept {
+  for (auto *coalescer : dirty_)
+    coalescer->flush(due_);
+  dirty_.clear();
+
+  for (auto &e : due_)
+    _emit(std::move(e));
+  due_.clear();
+}
+
 void EventManager::notify_clients() noexcept {
   remove_dead_clients(clients_);
+  flush_coalesced();
 
   while (!events_.empty()) {
     Event const &e = events_.front();
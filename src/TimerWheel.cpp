@@ -0,0 +1,129 @@
+#include "ecs/TimerWheel.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace ECS::Event {
+
+TimerID TimerWheel::schedule(uint64_t delay, uint64_t period, Factory make) {
+  uint32_t i;
+  if (free_ != none) {
+    i = free_;
+    free_ = nodes_[i].next;
+  } else {
+    i = static_cast<uint32_t>(nodes_.size());
+    nodes_.push_back({});
+  }
+
+  auto &node = nodes_[i];
+  // Timers expiring at base_ fire on the next tick
+  node.expires = base_ + (delay == 0 ? 0 : delay - 1);
+  node.period = period;
+  node.make = std::move(make);
+  node.active = true;
+  ++active_;
+
+  insert(i);
+  return {i, node.generation};
+}
+
+bool TimerWheel::cancel(TimerID id) noexcept {
+  if (id.index >= nodes_.size())
+    return false;
+
+  auto const &node = nodes_[id.index];
+  if (!node.active || node.generation != id.generation)
+    return false;
+
+  unlink(id.index);
+  release(id.index);
+  return true;
+}
+
+void TimerWheel::advance(uint64_t n, std::vector<Event> &out) {
+  for (auto k = 0uz; k != n; ++k) {
+    if (active_ == 0) {
+      base_ += n - k;
+      return;
+    }
+
+    const auto index = base_ & mask;
+    if (index == 0 && cascade(1, (base_ >> bits) & mask) == 0 &&
+        cascade(2, (base_ >> 2 * bits) & mask) == 0)
+      cascade(3, (base_ >> 3 * bits) & mask);
+    ++base_;
+
+    auto i = std::exchange(heads_[index], none);
+    while (i != none) {
+      auto &node = nodes_[i];
+      const auto next = node.next;
+
+      out.push_back(node.make());
+      if (node.period != 0) {
+        node.expires += node.period;
+        insert(i);
+      } else {
+        release(i);
+      }
+
+      i = next;
+    }
+  }
+}
+
+void TimerWheel::insert(uint32_t i) {
+  auto &node = nodes_[i];
+
+  uint32_t slot;
+  if (node.expires < base_) {
+    slot = static_cast<uint32_t>(base_ & mask);
+  } else {
+    const auto delta = std::min(node.expires - base_, max_delta);
+    const auto expires = base_ + delta;
+
+    auto level = 0u;
+    while (delta >> (bits * (level + 1)) != 0)
+      ++level;
+    slot = static_cast<uint32_t>(level * slots +
+                                 ((expires >> (bits * level)) & mask));
+  }
+
+  node.slot = slot;
+  node.prev = none;
+  node.next = heads_[slot];
+  if (node.next != none)
+    nodes_[node.next].prev = i;
+  heads_[slot] = i;
+}
+
+void TimerWheel::unlink(uint32_t i) noexcept {
+  auto const &node = nodes_[i];
+  if (node.prev != none)
+    nodes_[node.prev].next = node.next;
+  else
+    heads_[node.slot] = node.next;
+  if (node.next != none)
+    nodes_[node.next].prev = node.prev;
+}
+
+void TimerWheel::release(uint32_t i) noexcept {
+  auto &node = nodes_[i];
+  node.make = nullptr;
+  node.active = false;
+  ++node.generation;
+  node.next = free_;
+  free_ = i;
+  --active_;
+}
+
+uint64_t TimerWheel::cascade(unsigned level, uint64_t index) {
+  auto i = std::exchange(heads_[level * slots + index], none);
+  while (i != none) {
+    const auto next = nodes_[i].next;
+    insert(i);
+    i = next;
+  }
+  return index;
+}
+
+} // namespace ECS::Event
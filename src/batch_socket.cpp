@@ -0,0 +1,166 @@
+#include "pong/batch_socket.hpp"
+
+#include <arpa/inet.h>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+template <typename T> static T check(T result, char const *what) {
+  if (result < 0) {
+    perror(what);
+    std::exit(1);
+  }
+  return result;
+}
+
+BatchSocket::BatchSocket(in_port_t port, size_t batch_size, size_t packet_size)
+    : socket_{check(socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0), "socket")},
+      epoll_{check(epoll_create1(0), "epoll_create1")},
+      packet_size_{packet_size}, receive_buffer_(batch_size * packet_size),
+      receive_iov_(batch_size), receive_addresses_(batch_size),
+      receive_messages_(batch_size), send_buffer_(batch_size * packet_size),
+      send_iov_(batch_size), send_addresses_(batch_size),
+      send_messages_(batch_size) {
+  assert(batch_size > 0);
+
+  sockaddr_in const my_addr{.sin_family = AF_INET,
+                            .sin_port = htons(port),
+                            .sin_addr{INADDR_ANY},
+                            .sin_zero = {}};
+  check(bind(socket_, reinterpret_cast<sockaddr const *>(&my_addr),
+             sizeof(my_addr)),
+        "bind");
+
+  epoll_event event{};
+  event.events = EPOLLIN;
+  check(epoll_ctl(epoll_, EPOLL_CTL_ADD, socket_, &event), "epoll_ctl");
+
+  // The receive side never changes shape, so wire it up once
+  for (auto i = 0uz; i != batch_size; ++i) {
+    receive_iov_[i] = {receive_buffer_.data() + i * packet_size, packet_size};
+    receive_messages_[i].msg_hdr = {
+        .msg_name = &receive_addresses_[i],
+        .msg_namelen = sizeof(sockaddr_in),
+        .msg_iov = &receive_iov_[i],
+        .msg_iovlen = 1,
+        .msg_control = nullptr,
+        .msg_controllen = 0,
+        .msg_flags = 0,
+    };
+  }
+  packets_.reserve(batch_size);
+}
+
+BatchSocket::~BatchSocket() {
+  check(close(epoll_), "BatchSocket::close");
+  check(close(socket_), "BatchSocket::close");
+}
+
+in_port_t BatchSocket::port() const {
+  sockaddr_in my_addr;
+  socklen_t len = sizeof(my_addr);
+  check(getsockname(socket_, reinterpret_cast<sockaddr *>(&my_addr), &len),
+        "getsockname");
+  return ntohs(my_addr.sin_port);
+}
+
+bool BatchSocket::wait(std::chrono::milliseconds timeout) {
+  epoll_event event;
+  for (;;) {
+    auto const ready =
+        epoll_wait(epoll_, &event, 1, static_cast<int>(timeout.count()));
+    if (ready >= 0)
+      return ready > 0;
+    if (errno != EINTR)
+      check(ready, "epoll_wait");
+  }
+}
+
+std::span<BatchSocket::Packet const> BatchSocket::receive() {
+  packets_.clear();
+
+  for (auto &message : receive_messages_) {
+    message.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    message.msg_hdr.msg_flags = 0;
+  }
+
+  auto const received =
+      recvmmsg(socket_, receive_messages_.data(),
+               static_cast<unsigned>(receive_messages_.size()), 0, nullptr);
+  if (received < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return {};
+    check(received, "recvmmsg");
+  }
+
+  for (auto i = 0uz; i != static_cast<size_t>(received); ++i) {
+    // A partial datagram would pass for a valid one of a smaller type
+    if (receive_messages_[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      ++truncated_;
+      continue;
+    }
+
+    packets_.push_back({
+        .data = {receive_buffer_.data() + i * packet_size_,
+                 receive_messages_[i].msg_len},
+        .from = receive_addresses_[i],
+    });
+  }
+  return packets_;
+}
+
+void BatchSocket::queue(std::span<std::byte const> data, sockaddr_in const &to) {
+  if (data.size() > packet_size_) {
+    ++oversized_;
+    return;
+  }
+
+  if (queued_ == send_messages_.size())
+    flush();
+
+  auto *const slot = send_buffer_.data() + queued_ * packet_size_;
+  std::memcpy(slot, data.data(), data.size());
+
+  send_addresses_[queued_] = to;
+  send_iov_[queued_] = {slot, data.size()};
+  send_messages_[queued_].msg_hdr = {
+      .msg_name = &send_addresses_[queued_],
+      .msg_namelen = sizeof(sockaddr_in),
+      .msg_iov = &send_iov_[queued_],
+      .msg_iovlen = 1,
+      .msg_control = nullptr,
+      .msg_controllen = 0,
+      .msg_flags = 0,
+  };
+  ++queued_;
+}
+
+size_t BatchSocket::flush() {
+  auto sent = 0uz;
+  while (sent != queued_) {
+    auto const result =
+        sendmmsg(socket_, send_messages_.data() + sent,
+                 static_cast<unsigned>(queued_ - sent), 0);
+    if (result < 0) {
+      // Socket buffer is full, drop the rest like a congested link would
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      check(result, "sendmmsg");
+    }
+    sent += static_cast<size_t>(result);
+  }
+
+  queued_ = 0;
+  return sent;
+}
+
+sockaddr_in BatchSocket::loopback(in_port_t port) {
+  return {.sin_family = AF_INET,
+          .sin_port = htons(port),
+          .sin_addr{htonl(INADDR_LOOPBACK)},
+          .sin_zero = {}};
+}